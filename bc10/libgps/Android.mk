@@ -28,5 +28,7 @@ LOCAL_MODULE := gps.bc10
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
 
+include $(call all-makefiles-under,$(LOCAL_PATH))
+
 endif
 
@@ -4,6 +4,7 @@
 #include <utils/Log.h>
 
 #include <errno.h>
+#include <stdint.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,7 +15,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <semaphore.h>
 
 //  logging macro.
@@ -25,6 +28,10 @@
 //  TODO: dynamically set device filename
 #define TTY_DEV "/dev/ttyS1"
 
+//  Bytes taken from the tty per read(). At 57600 baud this is about
+//  0.2 seconds of NMEA, so one read usually drains the whole burst.
+#define TTY_READ_SIZE 1024
+
 //  GPS status setting macro
 #define setGpsStatus(_cb, _s)    \
   if ((_cb).status_cb) {          \
@@ -51,6 +58,19 @@
 //
 #define  NMEA_MAX_SIZE  83
 
+//  The framer's buffer: a read() chunk plus the unfinished sentence left
+//  over from the previous one.
+#define  NMEA_BUF_SIZE  (TTY_READ_SIZE + NMEA_MAX_SIZE + 1)
+
+//  The sentences of one receiver epoch that go into its fix.
+enum {
+    NMEA_EPOCH_GGA = 1 << 0,
+    NMEA_EPOCH_GLL = 1 << 1,
+    NMEA_EPOCH_GSA = 1 << 2,
+    NMEA_EPOCH_RMC = 1 << 3,
+    NMEA_EPOCH_VTG = 1 << 4
+};
+
 enum {
     STATE_QUIT  = 0,
     STATE_INIT  = 1,
@@ -58,16 +78,25 @@ enum {
 };
 
 typedef struct {
-    int            pos;
-    int            overflow;
+    int            len;         // bytes in in[], all of them before any '\n'
+    int            skipping;    // dropping the rest of an overlong line
+    unsigned       overflows;   // lines dropped for being too long
+    unsigned       resyncs;     // times garbage was skipped to find a '$'
+    unsigned       bad;         // sentences dropped for a bad checksum
+    unsigned       fixes;       // locations delivered
+    long long      epoch_tod;   // time of day of the epoch being built, or -1
+    unsigned       epoch_seen;  // NMEA_EPOCH_* sentences it has had so far
+    unsigned       epoch_expect;    // the ones the previous epoch had
+    int            epoch_sent;  // its fix is out, or was dropped
+    long long      last_sent;   // timestamp of the last fix delivered, or -1
     int            utc_year;
     int            utc_mon;
     int            utc_day;
-    int            utc_diff;
+    long long      utc_day_base;    // ms since the epoch at 00:00 of that day
     GpsLocation    fix;
     GpsSvStatus    sv_status;
     int            sv_status_changed;
-    char           in[ NMEA_MAX_SIZE+1 ];
+    char           in[ NMEA_BUF_SIZE ];
 } NmeaReader;
 
 //  
@@ -76,12 +105,12 @@ typedef struct {
 typedef struct {
     int             init;
     int             fd;
-    FILE            *fp;
+    int             stop_fd;        // eventfd, signalled by bc10_gps_stop()
     GpsCallbacks    callbacks;
     pthread_t       thread;
+    int             joinable;       // thread has not been joined yet
     int             fix_freq;
     sem_t           fix_sem;
-    int             first_fix;
 } bc10_GpsState;
 
 static bc10_GpsState _gps_state[1];
@@ -108,11 +137,47 @@ typedef struct {
     Token   tokens[ MAX_NMEA_TOKENS ];
 } NmeaTokenizer;
 
+//
+//  Word-at-a-time byte matching: sets 0x80 in every byte of w that equals
+//  the byte repeated in pattern, and nothing else. Unlike the classic
+//  (x - 0x01010101) & ~x trick this has no false hits above a match, so
+//  the bits can be walked with ctz.
+//
+#define  NMEA_BYTES(c)  ((uint32_t)(unsigned char)(c) * 0x01010101u)
+
+static inline uint32_t
+nmea_match_bytes( uint32_t  w, uint32_t  pattern )
+{
+    uint32_t  x = w ^ pattern;
+    return ~(((x & 0x7f7f7f7fu) + 0x7f7f7f7fu) | x | 0x7f7f7f7fu);
+}
+
+static int
+nmea_hex( int  c )
+{
+    if ((unsigned)(c - '0') < 10)
+        return c - '0';
+    c |= 0x20;
+    if ((unsigned)(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+//
+//  Splits a sentence into its fields and checks its checksum in the same
+//  pass. Four bytes are taken at a time (little-endian): words with no
+//  ',' or '*' are only XORed into the running checksum, and the others
+//  are walked one hit at a time. Returns the number of fields, or -1 if
+//  the '*hh' checksum is missing or does not match.
+//
 static int
 nmea_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end )
 {
-    int    count = 0;
-    char*  q;
+    int          count = 0;
+    const char*  field;
+    const char*  star = NULL;
+    uint32_t     sum = 0;
+    int          hi, lo;
 
     // the initial '$' is optional
     if (p < end && p[0] == '$')
@@ -125,28 +190,69 @@ nmea_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end )
             end -= 1;
     }
 
-    // get rid of checksum at the end of the sentecne
-    if (end >= p+3 && end[-3] == '*') {
-        end -= 3;
-    }
+    field = p;
+    while (p + 4 <= end) {
+        uint32_t  w, hits;
 
-    while (p < end) {
-        const char*  q = p;
+        memcpy(&w, p, 4);
+        hits = nmea_match_bytes(w, NMEA_BYTES(',')) |
+               nmea_match_bytes(w, NMEA_BYTES('*'));
 
-        q = memchr(p, ',', end-p);
-        if (q == NULL)
-            q = end;
+        while (hits) {
+            int          k = __builtin_ctz(hits) >> 3;
+            const char*  q = p + k;
+
+            if (*q == '*') {
+                star = q;
+                w &= (1u << (k * 8)) - 1;   // k < 4
+                break;
+            }
+            if (count < MAX_NMEA_TOKENS) {
+                t->tokens[count].p   = field;
+                t->tokens[count].end = q;
+                count += 1;
+            }
+            field = q + 1;
+            hits &= hits - 1;
+        }
+
+        sum ^= w;
+        if (star)
+            break;
+        p += 4;
+    }
 
-        if (count < MAX_NMEA_TOKENS) {
-            t->tokens[count].p   = p;
-            t->tokens[count].end = q;
-            count += 1;
+    for ( ; !star && p < end; p++) {
+        if (*p == '*') {
+            star = p;
+            break;
         }
+        if (*p == ',') {
+            if (count < MAX_NMEA_TOKENS) {
+                t->tokens[count].p   = field;
+                t->tokens[count].end = p;
+                count += 1;
+            }
+            field = p + 1;
+        }
+        sum ^= (unsigned char)*p;
+    }
 
-        if (q < end)
-            q += 1;
+    if (star == NULL || end - star != 3)
+        return -1;
 
-        p = q;
+    sum ^= sum >> 16;
+    sum ^= sum >> 8;
+    hi = nmea_hex(star[1]);
+    lo = nmea_hex(star[2]);
+    if (hi < 0 || lo < 0 || (sum & 0xff) != (uint32_t)(hi << 4 | lo))
+        return -1;
+
+    //  like the fields before it, but an empty last one is not a field.
+    if (field < star && count < MAX_NMEA_TOKENS) {
+        t->tokens[count].p   = field;
+        t->tokens[count].end = star;
+        count += 1;
     }
 
     t->count = count;
@@ -197,12 +303,62 @@ Fail:
     return -1;
 }
 
+//  Powers of ten, all exact as doubles.
+static const long long  nmea_pow10[16] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+    100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+    1000000000000LL, 10000000000000LL, 100000000000000LL,
+    1000000000000000LL
+};
+
+//
+//  Reads a plain decimal number, "[+-]ddd[.ddd]", straight from the token
+//  as the integer *mant and the number of digits after the point *frac,
+//  so its value is *mant / 10^*frac. Returns -1, leaving the job to
+//  strtod(), unless the whole token is such a number with at least one
+//  and at most 15 digits.
+//
+static int
+str2fixed( const char*  p, const char*  end, long long*  mant, int*  frac )
+{
+    long long  m = 0;
+    int        digits = 0;
+    int        point = -1;
+    int        neg = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    for ( ; p < end; p++) {
+        unsigned  c = (unsigned char)*p - '0';
+
+        if (c < 10) {
+            if (++digits > 15)
+                return -1;
+            m = m*10 + c;
+        } else if (*p == '.' && point < 0) {
+            point = digits;
+        } else {
+            return -1;
+        }
+    }
+    if (digits == 0)
+        return -1;
+
+    *mant = neg ? -m : m;
+    *frac = point < 0 ? 0 : digits - point;
+    return 0;
+}
+
 static double
 str2float( const char*  p, const char*  end )
 {
-    int   result = 0;
-    int   len    = end - p;
-    char  temp[16];
+    int        len    = end - p;
+    char       temp[16];
+    long long  mant;
+    int        frac;
 
     if (len == 0) {
       return -1.0;
@@ -211,6 +367,14 @@ str2float( const char*  p, const char*  end )
     if (len >= (int)sizeof(temp))
         return 0.;
 
+    //  both operands are exact, so the one rounding in the division gives
+    //  the correctly rounded value, the same double strtod() returns.
+    if (str2fixed(p, end, &mant, &frac) == 0) {
+        if (mant == 0)
+            return p[0] == '-' ? -0.0 : 0.0;
+        return (double)mant / (double)nmea_pow10[frac];
+    }
+
     memcpy( temp, p, len );
     temp[len] = 0;
     return strtod( temp, NULL );
@@ -224,47 +388,58 @@ str2float( const char*  p, const char*  end )
 /*****************************************************************/
 /*****************************************************************/
 
-static void
-nmea_reader_update_utc_diff( NmeaReader*  r )
+//
+//  Days from 1970-01-01 to the given date of the proleptic Gregorian
+//  calendar, in plain integer arithmetic (H. Hinnant's days_from_civil).
+//
+static long
+days_from_civil( int  y, int  m, int  d )
 {
-    time_t         now = time(NULL);
-    struct tm      tm_local;
-    struct tm      tm_utc;
-    long           time_local, time_utc;
-
-    gmtime_r( &now, &tm_utc );
-    localtime_r( &now, &tm_local );
-
-    time_local = tm_local.tm_sec +
-                 60*(tm_local.tm_min +
-                 60*(tm_local.tm_hour +
-                 24*(tm_local.tm_yday +
-                 365*tm_local.tm_year)));
-
-    time_utc = tm_utc.tm_sec +
-               60*(tm_utc.tm_min +
-               60*(tm_utc.tm_hour +
-               24*(tm_utc.tm_yday +
-               365*tm_utc.tm_year)));
-
-    r->utc_diff = time_utc - time_local;
+    long      era;
+    unsigned  yoe, doy, doe;
+
+    y  -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = (unsigned)(y - era * 400);
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long)doe - 719468;
 }
 
+//
+//  Sets the UTC date that following times of day belong to. The day's
+//  epoch is only recomputed when the date actually changes.
+//
+static int
+nmea_reader_set_date( NmeaReader*  r, int  year, int  mon, int  day )
+{
+    if (mon < 1 || mon > 12 || day < 1 || day > 31 || year < 0)
+        return -1;
+
+    if (year == r->utc_year && mon == r->utc_mon && day == r->utc_day)
+        return 0;
+
+    r->utc_year     = year;
+    r->utc_mon      = mon;
+    r->utc_day      = day;
+    r->utc_day_base = days_from_civil(year, mon, day) * 86400000LL;
+    return 0;
+}
 
 static void
 nmea_reader_init( NmeaReader*  r )
 {
     memset( r, 0, sizeof(*r) );
 
-    r->pos      = 0;
-    r->overflow = 0;
+    r->len      = 0;
+    r->skipping = 0;
     r->utc_year = -1;
     r->utc_mon  = -1;
     r->utc_day  = -1;
+    r->epoch_tod = -1;
+    r->last_sent = -1;
 //    r->callback = NULL;
     r->fix.size = sizeof( r->fix );
-
-    nmea_reader_update_utc_diff( r );
 }
 
 /*
@@ -280,39 +455,58 @@ nmea_reader_set_callback( NmeaReader*  r, gps_location_callback  cb )
 }
 */
 
-static int
-nmea_reader_update_time( NmeaReader*  r, Token  tok )
+//
+//  Milliseconds since midnight for an "hhmmss[.sss]" time, or -1. Digits
+//  past the third of a second are dropped.
+//
+static long long
+nmea_time_of_day( Token  tok )
 {
     int        hour, minute;
-    double     seconds;
-    struct tm  tm;
-    time_t     fix_time;
+    long long  mant;
+    int        frac;
+    long long  msec;
 
     if (tok.p + 6 > tok.end)
         return -1;
 
+    hour    = str2int(tok.p,   tok.p+2);
+    minute  = str2int(tok.p+2, tok.p+4);
+    if (hour < 0 || minute < 0 ||
+        str2fixed(tok.p+4, tok.end, &mant, &frac) < 0 || mant < 0)
+        return -1;
+
+    if (frac > 3)
+        msec = mant / nmea_pow10[frac - 3];
+    else
+        msec = mant * nmea_pow10[3 - frac];
+
+    return (hour * 3600 + minute * 60) * 1000LL + msec;
+}
+
+//
+//  Timestamps the fix from an "hhmmss[.sss]" time of day: the cached epoch
+//  of the current date plus the time, to the millisecond.
+//
+static int
+nmea_reader_update_time( NmeaReader*  r, Token  tok )
+{
+    long long  tod = nmea_time_of_day(tok);
+
+    if (tod < 0)
+        return -1;
+
     if (r->utc_year < 0) {
         // no date yet, get current one
-        time_t  now = time(NULL);
+        time_t     now = time(NULL);
+        struct tm  tm;
+
         gmtime_r( &now, &tm );
-        r->utc_year = tm.tm_year + 1900;
-        r->utc_mon  = tm.tm_mon + 1;
-        r->utc_day  = tm.tm_mday;
+        nmea_reader_set_date( r, tm.tm_year + 1900, tm.tm_mon + 1,
+                              tm.tm_mday );
     }
 
-    hour    = str2int(tok.p,   tok.p+2);
-    minute  = str2int(tok.p+2, tok.p+4);
-    seconds = str2float(tok.p+4, tok.end);
-
-    tm.tm_hour = hour;
-    tm.tm_min  = minute;
-    tm.tm_sec  = (int) seconds;
-    tm.tm_year = r->utc_year - 1900;
-    tm.tm_mon  = r->utc_mon - 1;
-    tm.tm_mday = r->utc_day;
-
-    fix_time = mktime( &tm ) + r->utc_diff;
-    r->fix.timestamp = (long long)fix_time * 1000;
+    r->fix.timestamp = r->utc_day_base + tod;
     return 0;
 }
 
@@ -326,11 +520,9 @@ nmea_reader_update_cdate( NmeaReader*  r,
          (tok_y.p + 4 > tok_y.end) )
         return -1;
 
-    r->utc_day  = str2int(tok_d.p, tok_d.p+2);
-    r->utc_mon  = str2int(tok_m.p, tok_m.p+2);
-    r->utc_year = str2int(tok_y.p, tok_y.end+4);
-
-    return 0;
+    return nmea_reader_set_date( r, str2int(tok_y.p, tok_y.p+4),
+                                    str2int(tok_m.p, tok_m.p+2),
+                                    str2int(tok_d.p, tok_d.p+2) );
 }
 
 static int
@@ -354,21 +546,37 @@ nmea_reader_update_date( NmeaReader*  r, Token  date, Token  time )
         return -1;
     }
 
-    r->utc_year  = year;
-    r->utc_mon   = mon;
-    r->utc_day   = day;
+    if (nmea_reader_set_date( r, year, mon, day ) < 0)
+        return -1;
 
     return nmea_reader_update_time( r, time );
 }
 
+//
+//  The degrees are split off the integer digits rather than with floor()
+//  on the double. The remaining arithmetic is kept as it was, so results
+//  stay bit-identical to the strtod() based conversion.
+//
 static double
 convert_from_hhmm( Token  tok )
 {
-    double  val     = str2float(tok.p, tok.end);
-    int     degrees = (int)(floor(val) / 100);
-    double  minutes = val - degrees*100.;
-    double  dcoord  = degrees + minutes / 60.0;
-    return dcoord;
+    double     val;
+    int        degrees;
+    double     minutes;
+    long long  mant;
+    int        frac;
+
+    if (tok.end - tok.p < 16 &&
+        str2fixed(tok.p, tok.end, &mant, &frac) == 0 &&
+        mant >= 0 && mant / nmea_pow10[frac] < 100000) {
+        val     = (double)mant / (double)nmea_pow10[frac];
+        degrees = (int)(mant / nmea_pow10[frac] / 100);
+    } else {
+        val     = str2float(tok.p, tok.end);
+        degrees = (int)(floor(val) / 100);
+    }
+    minutes = val - degrees*100.;
+    return degrees + minutes / 60.0;
 }
 
 static int
@@ -474,8 +682,76 @@ nmea_reader_update_speed( NmeaReader*  r,
 }
 
 
+//
+//  Delivers the fix of the epoch, unless it has no position or comes
+//  sooner than the requested fix interval after the last one. With no
+//  interval only the first fix of the session is delivered. Only this
+//  touches state shared with the HAL calls.
+//
+static void
+nmea_reader_publish( NmeaReader*  r )
+{
+    long long  interval;
+    long long  since;
+
+    r->epoch_sent = 1;
+    if (!(r->fix.flags & GPS_LOCATION_HAS_LAT_LONG))
+        return;
+
+    GPS_STATE_LOCK_FIX(gps_state);
+    interval = gps_state->fix_freq * 1000LL;
+    since    = r->fix.timestamp - r->last_sent;
+    if (r->last_sent < 0 ||
+        (interval > 0 && (since >= interval || since < 0))) {
+        if (gps_state->callbacks.location_cb)
+            gps_state->callbacks.location_cb( &r->fix );
+        r->last_sent = r->fix.timestamp;
+        r->fixes += 1;
+    }
+    GPS_STATE_UNLOCK_FIX(gps_state);
+}
+
+//
+//  Closes the epoch being built and starts the next. What the closed one
+//  had is what the next is expected to have. If its fix has not gone out
+//  yet, because it is the first epoch or the receiver dropped a sentence,
+//  it goes out now, late rather than never.
+//
+static void
+nmea_reader_epoch_begin( NmeaReader*  r, long long  tod )
+{
+    if (!r->epoch_sent)
+        nmea_reader_publish( r );
+    if (r->epoch_seen)
+        r->epoch_expect = r->epoch_seen;
+
+    r->epoch_tod  = tod;
+    r->epoch_seen = 0;
+    r->epoch_sent = 0;
+    r->fix.flags  = 0;
+}
+
+//
+//  Files a sentence under its receiver epoch. GGA, GLL and RMC carry the
+//  epoch's time, and a new time starts a new epoch. GSA and VTG do not, so
+//  one of them that the epoch already had starts the next.
+//
+static void
+nmea_reader_epoch( NmeaReader*  r, unsigned  sentence, long long  tod )
+{
+    if (tod >= 0) {
+        if (r->epoch_tod < 0)
+            r->epoch_tod = tod;
+        else if (tod != r->epoch_tod)
+            nmea_reader_epoch_begin( r, tod );
+    } else if (r->epoch_seen & sentence) {
+        nmea_reader_epoch_begin( r, -1 );
+    }
+    r->epoch_seen |= sentence;
+}
+
 static void
-nmea_reader_parse( NmeaReader*  r )
+nmea_reader_parse( NmeaReader*  r, const char*  p, const char*  end )
 {
     /* we received a complete sentence, now parse it to generate
     * a new GPS fix...
@@ -483,13 +759,17 @@ nmea_reader_parse( NmeaReader*  r )
     NmeaTokenizer  tzer[1];
     Token          tok;
 
-    BC10_GPS_DEBUG("Received: '%.*s'", r->pos, r->in);
-    if (r->pos < 9) {
+    BC10_GPS_DEBUG("Received: '%.*s'", (int)(end - p), p);
+    if (end - p < 9) {
 //        D("Too short. discarded.");
         return;
     }
 
-    nmea_tokenizer_init(tzer, r->in, r->in + r->pos);
+    if (nmea_tokenizer_init(tzer, p, end) < 0) {
+        BC10_GPS_DEBUG("bad checksum, dropped.");
+        r->bad += 1;
+        return;
+    }
 #if GPS_DEBUG
     {
         int  n;
@@ -514,6 +794,9 @@ nmea_reader_parse( NmeaReader*  r )
         // GPS fix
         Token  tok_fixstaus = nmea_tokenizer_get(tzer, 6);
 
+        nmea_reader_epoch( r, NMEA_EPOCH_GGA,
+                           nmea_time_of_day(nmea_tokenizer_get(tzer, 1)) );
+
         if (tok_fixstaus.p[0] > '0') {
             Token  tok_time          = nmea_tokenizer_get(tzer, 1);
             Token  tok_latitude      = nmea_tokenizer_get(tzer, 2);
@@ -534,6 +817,9 @@ nmea_reader_parse( NmeaReader*  r )
     } else if ( !memcmp(tok.p, "GLL", 3) ) {
         Token  tok_fixstaus = nmea_tokenizer_get(tzer, 6);
 
+        nmea_reader_epoch( r, NMEA_EPOCH_GLL,
+                           nmea_time_of_day(nmea_tokenizer_get(tzer, 5)) );
+
         if (tok_fixstaus.p[0] == 'A') {
             Token  tok_latitude      = nmea_tokenizer_get(tzer, 1);
             Token  tok_latitudeHemi  = nmea_tokenizer_get(tzer, 2);
@@ -552,7 +838,10 @@ nmea_reader_parse( NmeaReader*  r )
         Token  tok_fixStatus = nmea_tokenizer_get(tzer, 2);
         int i;
 
-        if (tok_fixStatus.p[0] != '\0' && tok_fixStatus.p[0] != '1') {
+        nmea_reader_epoch( r, NMEA_EPOCH_GSA, -1 );
+
+        if (tok_fixStatus.p < tok_fixStatus.end &&
+            tok_fixStatus.p[0] != '1') {
             Token  tok_accuracy = nmea_tokenizer_get(tzer,15);
 
             nmea_reader_update_accuracy( r, tok_accuracy );
@@ -628,6 +917,9 @@ nmea_reader_parse( NmeaReader*  r )
     } else if ( !memcmp(tok.p, "RMC", 3) ) {
         Token  tok_fixStatus = nmea_tokenizer_get(tzer, 2);
 
+        nmea_reader_epoch( r, NMEA_EPOCH_RMC,
+                           nmea_time_of_day(nmea_tokenizer_get(tzer, 1)) );
+
         if (tok_fixStatus.p[0] == 'A') {
             Token  tok_time          = nmea_tokenizer_get(tzer, 1);
             Token  tok_latitude      = nmea_tokenizer_get(tzer, 3);
@@ -652,7 +944,10 @@ nmea_reader_parse( NmeaReader*  r )
     } else if ( !memcmp(tok.p, "VTG", 3) ) {
         Token  tok_fixStatus = nmea_tokenizer_get(tzer, 9);
 
-        if (tok_fixStatus.p[0] != '\0' && tok_fixStatus.p[0] != 'N') {
+        nmea_reader_epoch( r, NMEA_EPOCH_VTG, -1 );
+
+        if (tok_fixStatus.p < tok_fixStatus.end &&
+            tok_fixStatus.p[0] != 'N') {
             Token  tok_bearing = nmea_tokenizer_get(tzer, 1);
             Token  tok_speed   = nmea_tokenizer_get(tzer, 5);
 
@@ -664,7 +959,7 @@ nmea_reader_parse( NmeaReader*  r )
         Token  tok_time;
         Token  tok_year = nmea_tokenizer_get(tzer, 4);
 
-        if (tok_year.p[0] != '\0') {
+        if (tok_year.p < tok_year.end) {
           Token  tok_day = nmea_tokenizer_get(tzer, 2);
           Token  tok_mon = nmea_tokenizer_get(tzer, 3);
 
@@ -673,7 +968,7 @@ nmea_reader_parse( NmeaReader*  r )
 
         tok_time  = nmea_tokenizer_get(tzer, 1);
 
-        if (tok_time.p[0] != '\0') {
+        if (tok_time.p < tok_time.end) {
 
           nmea_reader_update_time( r, tok_time );
 
@@ -685,41 +980,71 @@ nmea_reader_parse( NmeaReader*  r )
         BC10_GPS_DEBUG("unknown sentence '%.*s", tok.end-tok.p, tok.p);
     }
 
-    if (!gps_state->first_fix &&
-        r->fix.flags & GPS_LOCATION_HAS_LAT_LONG) {
-
-        if (gps_state->callbacks.location_cb) {
-            gps_state->callbacks.location_cb( &r->fix );
-            r->fix.flags = 0;
-        }
-
-        gps_state->first_fix = 1;
-    }
+    //  the epoch is complete once it has every sentence the last one had.
+    if (!r->epoch_sent && r->epoch_expect &&
+        (r->epoch_seen & r->epoch_expect) == r->epoch_expect)
+        nmea_reader_publish( r );
 }
 
+//
+//  Takes one complete line, '\n' included, and parses the sentence in it
+//  in place. Anything before the '$' is line noise or the tail of a
+//  sentence that was cut off, and is skipped.
+//
 static void
-nmea_reader_addc( NmeaReader*  r, int  c )
+nmea_reader_frame( NmeaReader*  r, const char*  p, const char*  end )
 {
-    if (r->overflow) {
-        r->overflow = (c != '\n');
+    if (r->skipping) {
+        r->skipping = 0;
         return;
     }
 
-    if (r->pos >= (int) sizeof(r->in)-1 ) {
-        r->overflow = 1;
-        r->pos      = 0;
+    if (p[0] != '$') {
+        const char*  q = memchr(p, '$', end - p);
+
+        r->resyncs += 1;
+        if (q == NULL)
+            return;
+        p = q;
+    }
+
+    if (end - p > NMEA_MAX_SIZE) {
+        r->overflows += 1;
         return;
     }
 
-    r->in[r->pos] = (char)c;
-    r->pos       += 1;
+    nmea_reader_parse( r, p, end );
+}
+
+//
+//  Frames the len bytes just read into in[] after the r->len already
+//  there. Sentences are found with memchr() and parsed straight out of
+//  the buffer; only the unfinished one at the end is moved back to the
+//  front, so a read() never has to wrap. A line that has outgrown any
+//  valid sentence is dropped up to its '\n'.
+//
+static void
+nmea_reader_feed( NmeaReader*  r, int  len )
+{
+    const char*  p    = r->in;
+    const char*  scan = r->in + r->len;
+    const char*  end  = scan + len;
+    const char*  nl;
+
+    while ((nl = memchr(scan, '\n', end - scan)) != NULL) {
+        nmea_reader_frame( r, p, nl + 1 );
+        p = scan = nl + 1;
+    }
 
-    if (c == '\n') {
-        GPS_STATE_LOCK_FIX(gps_state);
-        nmea_reader_parse( r );
-        GPS_STATE_UNLOCK_FIX(gps_state);
-        r->pos = 0;
+    if (end - p > NMEA_MAX_SIZE) {
+        if (!r->skipping)
+            r->overflows += 1;
+        r->skipping = 1;
+        p = end;
     }
+
+    r->len = end - p;
+    memmove( r->in, p, r->len );
 }
 
 /**                                        */
@@ -804,7 +1129,7 @@ void bc10_gps_cleanup(void)
     //  cleanup
     setGpsStatus(gps_state->callbacks, GPS_STATUS_ENGINE_OFF);
     close(gps_state->fd);
-    fclose(gps_state->fp);
+    close(gps_state->stop_fd);
     
     return;
 }
@@ -812,52 +1137,116 @@ void bc10_gps_cleanup(void)
 int bc10_gps_stop(void)
 {
     BC10_GPS_DEBUG("bc10_gps_stop called!");
+    uint64_t one = 1;
+
+    if (!gps_state->joinable)
+        return 0;
 
-    //    gps reader thread automatically stops.
+    //    wake the reader thread out of poll() and wait for it to leave;
+    //    it may already have left on an error.
     gps_state->init = STATE_QUIT;
+    write(gps_state->stop_fd, &one, sizeof(one));
     pthread_join(gps_state->thread, NULL);
+    gps_state->joinable = 0;
 
     setGpsStatus(gps_state->callbacks, GPS_STATUS_SESSION_END);
     return 0;
 }
 
+//
+//  Writes a whole command to the receiver.
+//
+static int
+bc10_gps_send( int  fd, const char*  cmd )
+{
+    int  len = strlen(cmd);
+    int  ret;
+
+    BC10_GPS_DEBUG("writing initial string -> %s", cmd);
+    while (len > 0) {
+        ret = write(fd, cmd, len);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        cmd += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+//
+//  Sleeps in poll() until the tty has data or bc10_gps_stop() signals
+//  stop_fd, and hands every byte to the NMEA reader as soon as it is read.
+//
 static void* 
 bc10_gps_reader_thread(void *args)
 {
     BC10_GPS_DEBUG("bc10_gps_reader_thread started!");
 
-    char buf[512];
     NmeaReader reader;
-    int len, nn, ret;
+    struct pollfd fds[2];
+    int len, ret;
 
     //  set init value
-    ret = 0;
-    ret = fputs("$PSRF104,35,139,0,96000,407952,1557,12,1*29\r\n", gps_state->fp);
-    //ret = fputs("$PSRF104,0,0,0,0,0,0,12,1*10\r\n", gps_state->fp);
-    if (ret == EOF) {
+    ret = bc10_gps_send(gps_state->fd, "$PSRF104,35,139,0,96000,407952,1557,12,1*29\r\n");
+    //ret = bc10_gps_send(gps_state->fd, "$PSRF104,0,0,0,0,0,0,12,1*10\r\n");
+    if (ret < 0)
         BC10_GPS_ERROR("bc10_gps_reader_thread: init value set error!(104)");
-    } else {
-        BC10_GPS_DEBUG("wrote initial string -> $PSRF104,35,139,0,96000,407952,1557,12,1*29");
-    }
 
-    ret = fputs("$PSRF106,21*0F\r\n", gps_state->fp);
-    if (ret == EOF) {
+    ret = bc10_gps_send(gps_state->fd, "$PSRF106,21*0F\r\n");
+    if (ret < 0)
         BC10_GPS_ERROR("bc10_gps_reader_thread: init value set error!(106)");
-    } else {
-        BC10_GPS_DEBUG("wrote initial string -> $PSRF106,21*0F");
-    }
+
     nmea_reader_init( &reader );
-    do {
-        if (fgets(buf, sizeof(buf), gps_state->fp) != NULL) {
-            len = strlen(buf);
-            for (nn = 0; nn < len; nn++) {
-                nmea_reader_addc( &reader, buf[nn] );
-            } 
+
+    fds[0].fd = gps_state->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = gps_state->stop_fd;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        ret = poll(fds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            BC10_GPS_ERROR("bc10_gps_reader_thread: poll failed: %s",
+                           strerror(errno));
+            break;
         }
-	sleep(gps_state->fix_freq);
-    } while (gps_state->init == STATE_START);
 
-    BC10_GPS_DEBUG("bc10_gps_reader_thread ended!");
+        if (fds[1].revents & POLLIN) {
+            uint64_t stop;
+            read(gps_state->stop_fd, &stop, sizeof(stop));
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            len = read(gps_state->fd, reader.in + reader.len,
+                       sizeof(reader.in) - reader.len);
+            if (len < 0) {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                BC10_GPS_ERROR("bc10_gps_reader_thread: read failed: %s",
+                               strerror(errno));
+                break;
+            }
+            if (len == 0) {
+                BC10_GPS_ERROR("bc10_gps_reader_thread: tty hung up");
+                break;
+            }
+            nmea_reader_feed( &reader, len );
+        }
+    }
+
+    BC10_GPS_DEBUG("bc10_gps_reader_thread ended! "
+                   "(%u fixes, %u overflows, %u resyncs, %u bad checksums)",
+                   reader.fixes, reader.overflows, reader.resyncs, reader.bad);
+
+    //  after an error, let the next bc10_gps_start() run a new thread.
+    if (gps_state->init == STATE_START)
+        gps_state->init = STATE_INIT;
 
     return 0;
 }
@@ -867,6 +1256,19 @@ int bc10_gps_start(void)
     BC10_GPS_DEBUG("bc10_gps_start called!");
 
     int ret;
+    uint64_t stop;
+
+    if (gps_state->init == STATE_START)
+        return 0;
+
+    //  reap a reader thread that left on an error, and drop any stop
+    //  request it never consumed, so the new thread does not see it.
+    if (gps_state->joinable) {
+        pthread_join(gps_state->thread, NULL);
+        gps_state->joinable = 0;
+    }
+    read(gps_state->stop_fd, &stop, sizeof(stop));
+
     setGpsStatus(gps_state->callbacks, GPS_STATUS_SESSION_BEGIN);
 
     //
@@ -882,6 +1284,7 @@ int bc10_gps_start(void)
         BC10_GPS_ERROR("bc10_gps_start failed because of thread creation failure: %d", ret);
         return ret;
     }
+    gps_state->joinable = 1;
     gps_state->init = STATE_START;
 
     return 0;
@@ -904,6 +1307,8 @@ static int bc10_gps_term_init(int fd)
     BC10_GPS_DEBUG("bc10_gps_term_init: got serial port speed %u", speed);
 
     ret = cfsetispeed(&ios, B57600);
+    if (ret == 0)
+        ret = cfsetospeed(&ios, B57600);
     if (ret < 0) {
         BC10_GPS_ERROR("bc10_gps_term_init: serial port setspeed failed!");
         return 1;
@@ -912,12 +1317,23 @@ static int bc10_gps_term_init(int fd)
     speed = cfgetispeed(&ios);
     BC10_GPS_DEBUG("bc10_gps_term_init: set serial port speed %u", speed);
 
-    if (ios.c_cflag | CRTSCTS) {
+    if (ios.c_cflag & CRTSCTS) {
         BC10_GPS_DEBUG("bc10_gps_term_init: hardware flow control is enabled");
         ios.c_cflag &= ~CRTSCTS;
         BC10_GPS_DEBUG("bc10_gps_term_init: disable hardware flow control");
     }
 
+    //  raw, non-canonical mode: read() returns whatever bytes have
+    //  arrived, without line editing or CR/LF translation.
+    ios.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP |
+                     INLCR | IGNCR | ICRNL | IXON | IXOFF);
+    ios.c_oflag &= ~OPOST;
+    ios.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    ios.c_cflag &= ~(CSIZE | PARENB);
+    ios.c_cflag |= CS8 | CLOCAL | CREAD;
+    ios.c_cc[VMIN]  = 1;
+    ios.c_cc[VTIME] = 0;
+
     ret = tcsetattr(fd, TCSANOW, &ios);
     if (ret < 0) {
         BC10_GPS_ERROR("bc10_gps_term_init: serial port attribute set failed!");
@@ -937,8 +1353,7 @@ int bc10_gps_init(GpsCallbacks *callbacks)
     gps_state->callbacks = *callbacks;
     setGpsStatus(gps_state->callbacks, GPS_STATUS_NONE);
 
-    FILE* fp;
-    int fd = open(TTY_DEV, O_RDWR);
+    int fd = open(TTY_DEV, O_RDWR | O_NOCTTY);
     int ret = 0;
     if (fd < 0) {
         BC10_GPS_ERROR("bc10_gps_init: gps device open failed! : %s", TTY_DEV);
@@ -959,17 +1374,17 @@ int bc10_gps_init(GpsCallbacks *callbacks)
         return 1;
     }
     
-    setGpsStatus(gps_state->callbacks, GPS_STATUS_ENGINE_ON);
-
-    fp = fdopen(fd, "w+");
-    if (!fp) {
-        BC10_GPS_ERROR("bc10_gps_init: device file open(fdopen) failed!");
+    gps_state->stop_fd = eventfd(0, EFD_NONBLOCK);
+    if (gps_state->stop_fd < 0) {
+        BC10_GPS_ERROR("bc10_gps_init: stop eventfd creation failed!");
+        close(fd);
         return 1;
     }
 
+    setGpsStatus(gps_state->callbacks, GPS_STATUS_ENGINE_ON);
+
     gps_state->init = STATE_INIT;
     gps_state->fd = fd;
-    gps_state->fp = fp;
 
     BC10_GPS_DEBUG("bc10_gps_init: success");
 
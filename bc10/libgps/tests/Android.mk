@@ -0,0 +1,37 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Host builds of the NMEA parser, checked against the reference code in
+# nmea_reference.h:
+#     gps_bc10_nmea_test     exits non-zero on any mismatch
+#     gps_bc10_nmea_bench    times the reference and current code
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gps_bc10_nmea_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := nmea_test.c
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread -lrt -lm
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gps_bc10_nmea_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := nmea_bench.c
+LOCAL_CFLAGS := -O2
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread -lrt -lm
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,163 @@
+//
+//  Host benchmark of the NMEA parsing in gps_bc10.c against the reference
+//  implementations in nmea_reference.h, on a synthetic corpus of SiRF
+//  style output (GGA, GSA, GSV, RMC and VTG every epoch).
+//
+#include "../gps_bc10.c"
+#include "nmea_reference.h"
+
+#define  BENCH_EPOCHS   20000
+#define  BENCH_ROUNDS   20
+
+typedef struct {
+    const char*  p;
+    const char*  end;
+} Line;
+
+static char  corpus[ BENCH_EPOCHS * 8 * 84 ];
+static Line  lines[ BENCH_EPOCHS * 8 ];
+static int   num_lines;
+
+static char*
+add_line( char*  out, const char*  body )
+{
+    unsigned     sum = 0;
+    const char*  p;
+    int          len;
+
+    for (p = body; *p; p++)
+        sum ^= (unsigned char)*p;
+    len = sprintf(out, "$%s*%02X\r\n", body, sum);
+    lines[num_lines].p   = out;
+    lines[num_lines].end = out + len;
+    num_lines += 1;
+    return out + len;
+}
+
+static void
+make_corpus( void )
+{
+    char      body[84];
+    char*     out = corpus;
+    unsigned  seed = 7;
+    int       e;
+
+    for (e = 0; e < BENCH_EPOCHS; e++) {
+        int     s   = e % 86400;
+        double  lat = 4807.038 + (rand_r(&seed) % 10000) / 1e4;
+        double  lon = 1131.000 + (rand_r(&seed) % 10000) / 1e4;
+
+        sprintf(body, "GPGGA,%02d%02d%02d.00,%.4f,N,%09.4f,E,1,08,0.9,"
+                "%.1f,M,46.9,M,,", s / 3600, s / 60 % 60, s % 60, lat, lon,
+                500 + (rand_r(&seed) % 1000) / 10.0);
+        out = add_line(out, body);
+        out = add_line(out, "GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1");
+        out = add_line(out, "GPGSV,2,1,08,01,40,083,46,02,17,308,41,"
+                            "12,07,344,39,14,22,228,45");
+        out = add_line(out, "GPGSV,2,2,08,15,10,044,,17,50,105,43,"
+                            "24,60,200,47,25,05,120,");
+        sprintf(body, "GPRMC,%02d%02d%02d.00,A,%.4f,N,%09.4f,E,%.1f,%.1f,"
+                "230394,003.1,W", s / 3600, s / 60 % 60, s % 60, lat, lon,
+                (rand_r(&seed) % 1000) / 10.0, (rand_r(&seed) % 3600) / 10.0);
+        out = add_line(out, body);
+        out = add_line(out, "GPVTG,054.7,T,034.4,M,005.5,N,010.2,K,A");
+    }
+}
+
+static long long
+now_ns( void )
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+bench_tokenizer( void )
+{
+    NmeaTokenizer  t;
+    volatile int   sink = 0;
+    long long      t0, t1, t2;
+    int            r, i;
+
+    t0 = now_ns();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < num_lines; i++)
+            sink += ref_tokenizer_init(&t, lines[i].p, lines[i].end);
+    t1 = now_ns();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < num_lines; i++)
+            sink += nmea_tokenizer_init(&t, lines[i].p, lines[i].end);
+    t2 = now_ns();
+
+    printf("tokenizer: reference %.1f ns/sentence (no checksum), "
+           "current %.1f ns/sentence (with checksum)\n",
+           (double)(t1 - t0) / ((double)BENCH_ROUNDS * num_lines),
+           (double)(t2 - t1) / ((double)BENCH_ROUNDS * num_lines));
+}
+
+static Token  fields[ BENCH_EPOCHS * 8 * 24 ];
+static int    num_fields;
+static Token  coords[ BENCH_EPOCHS * 4 ];
+static int    num_coords;
+
+static void
+bench_numbers( void )
+{
+    NmeaTokenizer    t;
+    volatile double  sink = 0;
+    long long        t0, t1, t2;
+    int              r, i, k;
+
+    for (i = 0; i < num_lines; i++) {
+        nmea_tokenizer_init(&t, lines[i].p, lines[i].end);
+        for (k = 1; k < t.count; k++)
+            fields[num_fields++] = t.tokens[k];
+        if (!memcmp(lines[i].p, "$GPGGA", 6) ||
+            !memcmp(lines[i].p, "$GPRMC", 6)) {
+            k = lines[i].p[3] == 'G' ? 2 : 3;
+            coords[num_coords++] = t.tokens[k];
+            coords[num_coords++] = t.tokens[k + 2];
+        }
+    }
+
+    t0 = now_ns();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < num_fields; i++)
+            sink += ref_str2float(fields[i].p, fields[i].end);
+    t1 = now_ns();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < num_fields; i++)
+            sink += str2float(fields[i].p, fields[i].end);
+    t2 = now_ns();
+
+    printf("str2float: reference %.1f ns/field, current %.1f ns/field\n",
+           (double)(t1 - t0) / ((double)BENCH_ROUNDS * num_fields),
+           (double)(t2 - t1) / ((double)BENCH_ROUNDS * num_fields));
+
+    t0 = now_ns();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < num_coords; i++)
+            sink += ref_convert_from_hhmm(coords[i]);
+    t1 = now_ns();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < num_coords; i++)
+            sink += convert_from_hhmm(coords[i]);
+    t2 = now_ns();
+
+    printf("convert_from_hhmm: reference %.1f ns/coordinate, "
+           "current %.1f ns/coordinate\n",
+           (double)(t1 - t0) / ((double)BENCH_ROUNDS * num_coords),
+           (double)(t2 - t1) / ((double)BENCH_ROUNDS * num_coords));
+}
+
+int
+main( void )
+{
+    make_corpus();
+    printf("%d sentences\n", num_lines);
+    bench_tokenizer();
+    bench_numbers();
+    return 0;
+}
@@ -0,0 +1,84 @@
+//
+//  The NMEA parsing code as it was before it was optimized, kept as the
+//  reference the host tests and benchmarks compare the current code to.
+//  Include it after gps_bc10.c, which provides the types.
+//
+
+//
+//  Fields as the memchr() tokenizer split them. It stripped the checksum
+//  without checking it.
+//
+static int
+ref_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end )
+{
+    int    count = 0;
+
+    // the initial '$' is optional
+    if (p < end && p[0] == '$')
+        p += 1;
+
+    // remove trailing newline
+    if (end > p && end[-1] == '\n') {
+        end -= 1;
+        if (end > p && end[-1] == '\r')
+            end -= 1;
+    }
+
+    // get rid of checksum at the end of the sentecne
+    if (end >= p+3 && end[-3] == '*') {
+        end -= 3;
+    }
+
+    while (p < end) {
+        const char*  q = p;
+
+        q = memchr(p, ',', end-p);
+        if (q == NULL)
+            q = end;
+
+        if (count < MAX_NMEA_TOKENS) {
+            t->tokens[count].p   = p;
+            t->tokens[count].end = q;
+            count += 1;
+        }
+
+        if (q < end)
+            q += 1;
+
+        p = q;
+    }
+
+    t->count = count;
+    return count;
+}
+
+//
+//  Numbers as strtod() on a NUL-terminated copy read them.
+//
+static double
+ref_str2float( const char*  p, const char*  end )
+{
+    int   len    = end - p;
+    char  temp[16];
+
+    if (len == 0) {
+      return -1.0;
+    }
+
+    if (len >= (int)sizeof(temp))
+        return 0.;
+
+    memcpy( temp, p, len );
+    temp[len] = 0;
+    return strtod( temp, NULL );
+}
+
+static double
+ref_convert_from_hhmm( Token  tok )
+{
+    double  val     = ref_str2float(tok.p, tok.end);
+    int     degrees = (int)(floor(val) / 100);
+    double  minutes = val - degrees*100.;
+    double  dcoord  = degrees + minutes / 60.0;
+    return dcoord;
+}
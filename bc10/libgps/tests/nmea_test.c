@@ -0,0 +1,195 @@
+//
+//  Host test of the NMEA parsing in gps_bc10.c against the reference
+//  implementations in nmea_reference.h. Exits non-zero on any mismatch.
+//
+#include "../gps_bc10.c"
+#include "nmea_reference.h"
+
+static int  failures;
+
+#define CHECK(cond, ...)                        \
+    do {                                        \
+        if (!(cond)) {                          \
+            if (failures++ < 10) {              \
+                fprintf(stderr, __VA_ARGS__);   \
+                fprintf(stderr, "\n");          \
+            }                                   \
+        }                                       \
+    } while (0)
+
+//
+//  Writes "$<body>*hh\r\n" with the right checksum and returns its length.
+//
+static int
+make_sentence( char*  out, const char*  body )
+{
+    unsigned  sum = 0;
+    const char*  p;
+
+    for (p = body; *p; p++)
+        sum ^= (unsigned char)*p;
+    return sprintf(out, "$%s*%02X\r\n", body, sum);
+}
+
+//
+//  A random body: a talker and sentence id, then up to 24 fields of up to
+//  12 characters, any of them empty, the last one included.
+//
+static void
+random_body( char*  body, unsigned*  seed )
+{
+    static const char  chars[] = "0123456789.-ABCNSEWMT";
+    int  fields = rand_r(seed) % 25;
+    int  f, k;
+
+    body += sprintf(body, "GP%c%c%c", 'A' + rand_r(seed) % 26,
+                    'A' + rand_r(seed) % 26, 'A' + rand_r(seed) % 26);
+    for (f = 0; f < fields; f++) {
+        int  len = rand_r(seed) % 3 ? rand_r(seed) % 13 : 0;
+
+        *body++ = ',';
+        for (k = 0; k < len; k++)
+            *body++ = chars[rand_r(seed) % (sizeof(chars) - 1)];
+    }
+    *body = '\0';
+}
+
+static void
+test_tokenizer( void )
+{
+    static const char*  fixed[] = {
+        "GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,",
+        "GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1",
+        "GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W",
+        "GPVTG,054.7,T,034.4,M,005.5,N,010.2,K,",
+        "GPZDA,201530.00,04,07,2002,00,00",
+        "GPGSV,1,1,00",
+        "GPTXT",
+        "",
+        ",",
+        ",,,",
+    };
+    char      body[400], line[420];
+    unsigned  seed = 1;
+    int       n, i, k;
+
+    for (n = 0; n < 200000 + (int)(sizeof(fixed) / sizeof(fixed[0])); n++) {
+        NmeaTokenizer  a, b;
+        int            len, ca, cb;
+
+        if (n < (int)(sizeof(fixed) / sizeof(fixed[0])))
+            strcpy(body, fixed[n]);
+        else
+            random_body(body, &seed);
+        len = make_sentence(line, body);
+
+        ca = ref_tokenizer_init(&a, line, line + len);
+        cb = nmea_tokenizer_init(&b, line, line + len);
+        CHECK(ca == cb, "'%s': %d fields, reference %d", body, cb, ca);
+        for (k = 0; k < ca && k < cb; k++) {
+            CHECK(a.tokens[k].p == b.tokens[k].p &&
+                  a.tokens[k].end == b.tokens[k].end,
+                  "'%s': field %d differs", body, k);
+        }
+        for (k = 0; k < MAX_NMEA_TOKENS + 1; k++) {
+            Token  ta = nmea_tokenizer_get(&a, k);
+            Token  tb = nmea_tokenizer_get(&b, k);
+
+            CHECK(ta.end - ta.p == tb.end - tb.p &&
+                  (ta.p == ta.end || ta.p[0] == tb.p[0]),
+                  "'%s': token %d differs", body, k);
+        }
+
+        //  any change to a single bit of the body or checksum is caught.
+        for (i = 0; i < 2; i++) {
+            int   pos = 1 + rand_r(&seed) % (len - 3);
+            char  old = line[pos];
+
+            //  the case of a checksum digit does not matter.
+            line[pos] ^= 1 << (rand_r(&seed) % 7);
+            if (pos < len - 4 || nmea_hex(line[pos]) != nmea_hex(old))
+                CHECK(nmea_tokenizer_init(&b, line, line + len) < 0,
+                      "'%.*s': corruption not detected", len - 2, line);
+            line[pos] = old;
+        }
+    }
+
+    {
+        static const char  bare[] = "$GPGSV,1,1,00\r\n";
+        NmeaTokenizer      t;
+
+        CHECK(nmea_tokenizer_init(&t, bare, bare + sizeof(bare) - 1) < 0,
+              "sentence without a checksum accepted");
+    }
+}
+
+//
+//  Same bits, or both NaN.
+//
+static int
+same_double( double  a, double  b )
+{
+    return memcmp(&a, &b, sizeof(a)) == 0 || (a != a && b != b);
+}
+
+static void
+check_number( const char*  s, int  len )
+{
+    Token  tok;
+
+    tok.p   = s;
+    tok.end = s + len;
+    CHECK(same_double(str2float(tok.p, tok.end), ref_str2float(tok.p, tok.end)),
+          "str2float('%.*s') = %a, reference %a", len, s,
+          str2float(tok.p, tok.end), ref_str2float(tok.p, tok.end));
+    CHECK(same_double(convert_from_hhmm(tok), ref_convert_from_hhmm(tok)),
+          "convert_from_hhmm('%.*s') = %a, reference %a", len, s,
+          convert_from_hhmm(tok), ref_convert_from_hhmm(tok));
+}
+
+//
+//  str2float() and convert_from_hhmm() must give the very bits strtod()
+//  did: every latitude and longitude minute at a random 4-digit fraction,
+//  then random strings of digits, signs, dots, exponents and junk.
+//
+static void
+test_numbers( void )
+{
+    static const char  chars[] = "0123456789.-+eE x";
+    char      s[32];
+    unsigned  seed = 2;
+    int       deg, min, i, k, len;
+
+    for (deg = 0; deg < 180; deg++) {
+        for (min = 0; min < 6000; min++) {
+            len = sprintf(s, "%d%02d.%02d%04d", deg, min / 100, min % 100,
+                          rand_r(&seed) % 10000);
+            check_number(s, len);
+            check_number(s, len - 2);
+        }
+    }
+
+    for (i = 0; i < 2000000; i++) {
+        len = rand_r(&seed) % 18;
+        for (k = 0; k < len; k++) {
+            int  n = (k < 2 || rand_r(&seed) % 50 == 0) ? 17 : 11;
+            s[k] = chars[rand_r(&seed) % n];
+        }
+        s[len] = '\0';
+        check_number(s, len);
+    }
+}
+
+int
+main( void )
+{
+    test_tokenizer();
+    test_numbers();
+
+    if (failures) {
+        fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("all NMEA tests passed\n");
+    return 0;
+}
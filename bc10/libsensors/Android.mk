@@ -28,11 +28,16 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
-LOCAL_SRC_FILES := poll_bc10.cpp sensors_bc10.c
+LOCAL_SRC_FILES := poll_bc10.cpp source_bc10.cpp convert_bc10.cpp filter_bc10.cpp \
+	record_bc10.cpp stats_bc10.cpp fusion_bc10.cpp calib_bc10.cpp \
+	channel_bc10.cpp \
+	sensors_bc10.c
 				
 LOCAL_SHARED_LIBRARIES := liblog libcutils
 LOCAL_PRELINK_MODULE := false
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(call all-makefiles-under,$(LOCAL_PATH))
+
 endif # !TARGET_SIMULATOR
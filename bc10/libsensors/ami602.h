@@ -24,4 +24,32 @@ struct ami602_position {
 #define AMI602_IOC_MAGIC	'B'
 #define AMI602_IOCPOSITION	_IOR(AMI602_IOC_MAGIC, 0, struct ami602_position)
 
+/*
+ * Triggered measurement (bc10 extension).
+ *
+ * AMI602_IOCTRIGGER pulses pin_trg to start one measurement and returns
+ * without waiting for it. The device then polls POLLIN once pin_bsy
+ * signals that the result is latched, and the next AMI602_IOCPOSITION
+ * returns it without blocking. Drivers without the extension fail the
+ * ioctl with ENOTTY.
+ */
+#define AMI602_IOCTRIGGER	_IO(AMI602_IOC_MAGIC, 1)
+
+/*
+ * Streaming FIFO (bc10 extension).
+ *
+ * AMI602_IOCSFIFO makes the driver sample on its own every period
+ * nanoseconds (0 stops it) and queue each position with the
+ * CLOCK_MONOTONIC time it was captured at. read() returns as many whole
+ * struct ami602_sample records as fit in the buffer, and poll() reports
+ * POLLIN while the FIFO is not empty. Drivers without the extension fail
+ * the ioctl with ENOTTY.
+ */
+struct ami602_sample {
+	long long timestamp;
+	struct ami602_position pos;
+};
+
+#define AMI602_IOCSFIFO		_IOW(AMI602_IOC_MAGIC, 2, long long)
+
 #endif
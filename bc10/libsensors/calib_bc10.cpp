@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include <cutils/log.h>
+#include <hardware/sensors.h>
+
+#include "calib_bc10.h"
+
+/*****************************************************************************/
+
+EllipsoidFit::EllipsoidFit()
+{
+    reset();
+}
+
+void EllipsoidFit::reset()
+{
+    memset(mAtA, 0, sizeof(mAtA));
+    memset(mAtb, 0, sizeof(mAtb));
+    for (int i = 0; i < 3; i++) {
+        mMin[i] = INFINITY;
+        mMax[i] = -INFINITY;
+    }
+    mCount = 0;
+}
+
+void EllipsoidFit::add(const float p[3])
+{
+    double row[6];
+
+    for (int i = 0; i < 3; i++) {
+        row[i] = (double)p[i] * p[i];
+        row[3 + i] = p[i];
+        if (p[i] < mMin[i])
+            mMin[i] = p[i];
+        if (p[i] > mMax[i])
+            mMax[i] = p[i];
+    }
+    for (int i = 0; i < 6; i++) {
+        for (int j = i; j < 6; j++)
+            mAtA[i][j] += row[i] * row[j];
+        mAtb[i] += row[i];
+    }
+    mCount++;
+}
+
+/*
+ * Solves the normal equations by Gaussian elimination with partial
+ * pivoting, then completes the squares. The points must also span at
+ * least one radius along every axis: a fit to a patch of the surface
+ * extrapolates the rest and is not worth having.
+ */
+bool EllipsoidFit::solve(float center[3], float radii[3]) const
+{
+    double m[6][7];
+    double p[6];
+    double g, scale = 0;
+
+    if (mCount < 6)
+        return false;
+
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 6; j++)
+            m[i][j] = j >= i ? mAtA[i][j] : mAtA[j][i];
+        m[i][6] = mAtb[i];
+        if (fabs(m[i][i]) > scale)
+            scale = fabs(m[i][i]);
+    }
+
+    for (int k = 0; k < 6; k++) {
+        int pivot = k;
+        for (int i = k + 1; i < 6; i++) {
+            if (fabs(m[i][k]) > fabs(m[pivot][k]))
+                pivot = i;
+        }
+        if (fabs(m[pivot][k]) < scale * 1e-12)
+            return false;
+        if (pivot != k) {
+            for (int j = k; j < 7; j++) {
+                double t = m[k][j];
+                m[k][j] = m[pivot][j];
+                m[pivot][j] = t;
+            }
+        }
+        for (int i = k + 1; i < 6; i++) {
+            double f = m[i][k] / m[k][k];
+            for (int j = k; j < 7; j++)
+                m[i][j] -= f * m[k][j];
+        }
+    }
+    for (int k = 5; k >= 0; k--) {
+        double s = m[k][6];
+        for (int j = k + 1; j < 6; j++)
+            s -= m[k][j] * p[j];
+        p[k] = s / m[k][k];
+    }
+
+    g = 1;
+    for (int i = 0; i < 3; i++) {
+        if (p[i] <= 0)
+            return false;
+        g += p[3 + i] * p[3 + i] / (4 * p[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        center[i] = (float)(-p[3 + i] / (2 * p[i]));
+        radii[i] = (float)sqrt(g / p[i]);
+        if (mMax[i] - mMin[i] < radii[i])
+            return false;
+    }
+    return true;
+}
+
+/*****************************************************************************/
+
+// Field strengths found anywhere on Earth, with margin.
+#define MAG_MIN_UT          15.0f
+#define MAG_MAX_UT          100.0f
+#define MAG_STEP_UT         5.0f
+// Largest soft-iron distortion believed, as a ratio of radii.
+#define MAG_MAX_SKEW        1.5f
+#define ACCEL_STEP          2.0f    // m/s^2 between poses
+#define ACCEL_STILL_VAR     0.02f   // (m/s^2)^2 per axis
+#define ACCEL_MAX_SKEW      0.3f    // radius within 30% of 1 g
+// Corrections smaller than this, relative to the radius, are left alone.
+#define MIN_CORRECTION      0.005f
+
+Calibrator::Calibrator()
+    : mAccelN(0)
+{
+    ami602_default_coeffs(&mCoeffs);
+    for (int i = 0; i < 3; i++) {
+        mMagLast[i] = INFINITY;
+        mAccelLast[i] = INFINITY;
+        mAccelSum[i] = 0;
+        mAccelSq[i] = 0;
+    }
+}
+
+int Calibrator::load(const char* path)
+{
+    struct ami602_coeffs c;
+    int version, n = 0;
+    FILE* f;
+
+    f = fopen(path, "r");
+    if (!f)
+        return -errno;
+
+    ami602_default_coeffs(&c);
+    if (fscanf(f, "bc10-calib %d", &version) == 1 && version == 1) {
+        n += fscanf(f, " scale %f %f %f %f %f %f",
+                &c.scale[0], &c.scale[1], &c.scale[2],
+                &c.scale[3], &c.scale[4], &c.scale[5]);
+        n += fscanf(f, " offset %f %f %f %f %f %f",
+                &c.offset[0], &c.offset[1], &c.offset[2],
+                &c.offset[3], &c.offset[4], &c.offset[5]);
+    }
+    fclose(f);
+
+    for (int k = 0; k < 6 && n == 12; k++) {
+        if (!isfinite(c.scale[k]) || !isfinite(c.offset[k]) ||
+                c.scale[k] == 0)
+            n = 0;
+    }
+    if (n != 12) {
+        LOGW("ignoring malformed calibration in %s", path);
+        return -EINVAL;
+    }
+    mCoeffs = c;
+    return 0;
+}
+
+int Calibrator::save(const char* path, const struct ami602_coeffs& c)
+{
+    char tmp[PATH_MAX];
+    FILE* f;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (!f)
+        return -errno;
+
+    // %.9g round-trips a float exactly.
+    fprintf(f, "bc10-calib 1\n");
+    fprintf(f, "scale %.9g %.9g %.9g %.9g %.9g %.9g\n",
+            c.scale[0], c.scale[1], c.scale[2],
+            c.scale[3], c.scale[4], c.scale[5]);
+    fprintf(f, "offset %.9g %.9g %.9g %.9g %.9g %.9g\n",
+            c.offset[0], c.offset[1], c.offset[2],
+            c.offset[3], c.offset[4], c.offset[5]);
+
+    if (fclose(f) || rename(tmp, path))
+        return -errno;
+    return 0;
+}
+
+bool Calibrator::update(const struct ami602_vec* v, int count)
+{
+    bool changed = false;
+
+    for (int i = 0; i < count; i++) {
+        changed |= updateMag(v[i].mag);
+        changed |= updateAccel(v[i].accel);
+    }
+    return changed;
+}
+
+bool Calibrator::updateMag(const float m[3])
+{
+    float center[3], radii[3], scale[3];
+    float d0 = m[0] - mMagLast[0];
+    float d1 = m[1] - mMagLast[1];
+    float d2 = m[2] - mMagLast[2];
+    float lo, hi, mean;
+
+    if (d0 * d0 + d1 * d1 + d2 * d2 < MAG_STEP_UT * MAG_STEP_UT)
+        return false;
+    mMagLast[0] = m[0];
+    mMagLast[1] = m[1];
+    mMagLast[2] = m[2];
+
+    mMagFit.add(m);
+    if (mMagFit.count() < MAG_MIN_POINTS)
+        return false;
+    if (!mMagFit.solve(center, radii)) {
+        if (mMagFit.count() >= MAG_MAX_POINTS)
+            mMagFit.reset();
+        return false;
+    }
+    mMagFit.reset();
+
+    lo = hi = mean = radii[0];
+    for (int i = 1; i < 3; i++) {
+        lo = fminf(lo, radii[i]);
+        hi = fmaxf(hi, radii[i]);
+        mean += radii[i];
+    }
+    mean /= 3;
+    if (lo < MAG_MIN_UT || hi > MAG_MAX_UT || hi > lo * MAG_MAX_SKEW)
+        return false;
+
+    // Soft iron: make the ellipsoid a sphere of the same mean radius.
+    for (int i = 0; i < 3; i++)
+        scale[i] = mean / radii[i];
+    return apply(3, center, scale, mean);
+}
+
+bool Calibrator::updateAccel(const float a[3])
+{
+    float mean[3], center[3], radii[3], scale[3];
+    float dist = 0;
+
+    for (int i = 0; i < 3; i++) {
+        mAccelSum[i] += a[i];
+        mAccelSq[i] += (double)a[i] * a[i];
+    }
+    if (++mAccelN < ACCEL_WINDOW)
+        return false;
+
+    for (int i = 0; i < 3; i++) {
+        double mu = mAccelSum[i] / mAccelN;
+        double var = mAccelSq[i] / mAccelN - mu * mu;
+        mean[i] = (float)(var < ACCEL_STILL_VAR ? mu : NAN);
+        dist += (mean[i] - mAccelLast[i]) * (mean[i] - mAccelLast[i]);
+        mAccelSum[i] = 0;
+        mAccelSq[i] = 0;
+    }
+    mAccelN = 0;
+
+    // Moving (a NaN mean), or still in a pose we already have.
+    if (!(dist >= ACCEL_STEP * ACCEL_STEP))
+        return false;
+    mAccelLast[0] = mean[0];
+    mAccelLast[1] = mean[1];
+    mAccelLast[2] = mean[2];
+
+    mAccelFit.add(mean);
+    if (mAccelFit.count() < ACCEL_MIN_POINTS)
+        return false;
+    if (!mAccelFit.solve(center, radii)) {
+        if (mAccelFit.count() >= ACCEL_MAX_POINTS)
+            mAccelFit.reset();
+        return false;
+    }
+    mAccelFit.reset();
+
+    for (int i = 0; i < 3; i++) {
+        if (fabsf(radii[i] / GRAVITY_EARTH - 1) > ACCEL_MAX_SKEW)
+            return false;
+        scale[i] = GRAVITY_EARTH / radii[i];
+    }
+    return apply(0, center, scale, GRAVITY_EARTH);
+}
+
+/*
+ * Folds out' = (out - center) * scale into the coefficients of channels
+ * first..first+2, unless the correction is negligible.
+ */
+bool Calibrator::apply(int first, const float center[3],
+        const float scale[3], float radius)
+{
+    bool significant = false;
+
+    for (int i = 0; i < 3; i++) {
+        if (fabsf(center[i]) > radius * MIN_CORRECTION ||
+                fabsf(scale[i] - 1) > MIN_CORRECTION)
+            significant = true;
+    }
+    if (!significant)
+        return false;
+
+    for (int i = 0; i < 3; i++) {
+        int k = first + i;
+        mCoeffs.offset[k] = (mCoeffs.offset[k] - center[i]) * scale[i];
+        mCoeffs.scale[k] *= scale[i];
+    }
+    LOGI("%s calibration updated: offset %f %f %f scale %f %f %f",
+            first ? "magnetometer" : "accelerometer",
+            center[0], center[1], center[2], scale[0], scale[1], scale[2]);
+    return true;
+}
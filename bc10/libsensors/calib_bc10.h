@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_CALIB_BC10_H
+#define ANDROID_SENSORS_CALIB_BC10_H
+
+#include <stdint.h>
+#include "convert_bc10.h"
+
+/*****************************************************************************/
+
+// Where calibration persists across boots, and whether it keeps learning.
+#define AMI602_CALIB_FILE       "/data/misc/sensors/bc10_calib"
+#define AMI602_CALIB_PROPERTY   "sensors.bc10.calib"    // "0" freezes it
+#define AMI602_CALIB_SAVE_MS    60000   // least time between two saves
+
+/*
+ * Least-squares fit of an axis-aligned ellipsoid
+ *     a x^2 + b y^2 + c z^2 + d x + e y + f z = 1
+ * to a point cloud, accumulated as normal equations so each point costs a
+ * fixed 27 multiply-adds and nothing is stored.
+ */
+class EllipsoidFit {
+public:
+    EllipsoidFit();
+
+    void reset();
+    void add(const float p[3]);
+    int count() const { return mCount; }
+
+    // Returns false if the points do not pin down an ellipsoid.
+    bool solve(float center[3], float radii[3]) const;
+
+private:
+    double mAtA[6][6];
+    double mAtb[6];
+    float mMin[3];
+    float mMax[3];
+    int mCount;
+};
+
+/*
+ * Online calibration of both sensors, run on converted samples:
+ *
+ * Magnetometer: hard-iron offset and soft-iron scale from an ellipsoid
+ * fitted to field readings taken as the device turns. A point is only
+ * added once the field has moved MAG_STEP_UT from the previous one, so
+ * holding still does not skew the fit.
+ *
+ * Accelerometer: offset and scale from an ellipsoid fitted to the mean of
+ * every still period (ACCEL_WINDOW samples with little variance) in a new
+ * pose, whose radius must be 1 g.
+ *
+ * An accepted fit is folded into the conversion coefficients, so it
+ * applies from the next batch on at no cost per sample. The owner writes
+ * them to AMI602_CALIB_FILE with save() so the next boot starts calibrated.
+ */
+class Calibrator {
+public:
+    Calibrator();
+
+    const struct ami602_coeffs& coeffs() const { return mCoeffs; }
+
+    int load(const char* path);
+    static int save(const char* path, const struct ami602_coeffs& c);
+
+    // Learns from count samples converted with coeffs(). Returns true if
+    // coeffs() changed.
+    bool update(const struct ami602_vec* v, int count);
+
+private:
+    enum {
+        MAG_MIN_POINTS = 48,
+        MAG_MAX_POINTS = 1024,
+        ACCEL_WINDOW = 32,
+        ACCEL_MIN_POINTS = 8,
+        ACCEL_MAX_POINTS = 64,
+    };
+
+    bool updateMag(const float m[3]);
+    bool updateAccel(const float a[3]);
+    bool apply(int first, const float center[3], const float scale[3],
+            float radius);
+
+    struct ami602_coeffs mCoeffs;
+
+    EllipsoidFit mMagFit;
+    float mMagLast[3];
+
+    EllipsoidFit mAccelFit;
+    float mAccelLast[3];
+    double mAccelSum[3];
+    double mAccelSq[3];
+    int mAccelN;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_CALIB_BC10_H
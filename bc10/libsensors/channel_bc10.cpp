@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/log.h>
+
+#include "poll_bc10.h"
+#include "channel_bc10.h"
+
+/*****************************************************************************/
+
+Ami602ChannelServer::Ami602ChannelServer()
+    : mShmFd(-1), mChannel(NULL), mListenFd(-1), mNumRegistered(0)
+{
+    for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++) {
+        mSocks[i] = -1;
+        mEventFds[i] = -1;
+        mSlotFds[i] = -1;
+        mSlots[i] = NULL;
+        mPeriods[i] = 0;
+    }
+}
+
+Ami602ChannelServer::~Ami602ChannelServer()
+{
+    for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++)
+        drop(i);
+    if (mListenFd >= 0)
+        close(mListenFd);
+    if (mChannel)
+        munmap(mChannel, sizeof(*mChannel));
+    if (mShmFd >= 0)
+        close(mShmFd);
+}
+
+/*
+ * The HAL keeps the only writable mapping of the ring: the region is
+ * restricted to read-only mappings before its fd is handed to anyone.
+ */
+int Ami602ChannelServer::open()
+{
+    void* map;
+    int err;
+
+    mShmFd = ashmem_create_region("bc10-sensors", sizeof(*mChannel));
+    if (mShmFd < 0) {
+        err = -errno;
+        LOGE("cannot create channel memory (%s)", strerror(-err));
+        return err;
+    }
+    map = mmap(NULL, sizeof(*mChannel), PROT_READ | PROT_WRITE, MAP_SHARED,
+            mShmFd, 0);
+    if (map == MAP_FAILED) {
+        err = -errno;
+        LOGE("cannot map channel memory (%s)", strerror(-err));
+        return err;
+    }
+    mChannel = (struct ami602_channel*)map;
+    memset(mChannel, 0, sizeof(*mChannel));
+    mChannel->slots = AMI602_CHANNEL_SLOTS;
+    mChannel->record_size = sizeof(struct ami602_sample);
+    mChannel->magic = AMI602_CHANNEL_MAGIC;
+    if (ashmem_set_prot_region(mShmFd, PROT_READ) < 0) {
+        err = -errno;
+        LOGE("cannot make channel memory read-only (%s)", strerror(-err));
+        return err;
+    }
+
+    mListenFd = socket_local_server(AMI602_CHANNEL_SOCKET,
+            ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
+    if (mListenFd < 0) {
+        err = -errno;
+        LOGE("cannot listen on @%s (%s)", AMI602_CHANNEL_SOCKET,
+                strerror(-err));
+        return err;
+    }
+    fcntl(mListenFd, F_SETFL, O_NONBLOCK);
+    LOGI("serving raw samples on @%s", AMI602_CHANNEL_SOCKET);
+    return 0;
+}
+
+int Ami602ChannelServer::pollFds(struct pollfd* fds) const
+{
+    int n = 0;
+
+    fds[n].fd = mListenFd;
+    fds[n].events = POLLIN;
+    n++;
+    for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++) {
+        if (mSocks[i] < 0)
+            continue;
+        fds[n].fd = mSocks[i];
+        fds[n].events = POLLIN;
+        n++;
+    }
+    return n;
+}
+
+bool Ami602ChannelServer::handle(const struct pollfd* fds, int count)
+{
+    bool changed = false;
+
+    for (int k = 0; k < count; k++) {
+        if (!fds[k].revents)
+            continue;
+        if (fds[k].fd == mListenFd) {
+            accept();
+            continue;
+        }
+        for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++) {
+            if (mSocks[i] != fds[k].fd)
+                continue;
+            // A registered client never writes again: anything further
+            // is a hang-up.
+            if (!mPeriods[i] && (fds[k].revents & POLLIN)) {
+                changed |= registerClient(i);
+            } else {
+                changed |= mPeriods[i] != 0;
+                drop(i);
+            }
+            break;
+        }
+    }
+    return changed;
+}
+
+/*
+ * Takes a new connection into a free slot. Only root and the uid the HAL
+ * runs as may connect.
+ */
+bool Ami602ChannelServer::accept()
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    int fd;
+
+    fd = ::accept(mListenFd, NULL, NULL);
+    if (fd < 0)
+        return false;
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        LOGW("cannot identify channel client (%s)", strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (cred.uid != 0 && cred.uid != getuid()) {
+        LOGW("refusing channel client uid %d", (int)cred.uid);
+        close(fd);
+        return false;
+    }
+    for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++) {
+        if (mSocks[i] < 0) {
+            mSocks[i] = fd;
+            return true;
+        }
+    }
+    LOGW("too many channel clients");
+    close(fd);
+    return false;
+}
+
+/*
+ * Reads the client's period and hands it the ring, its slot and its
+ * eventfd.
+ */
+bool Ami602ChannelServer::registerClient(int slot)
+{
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    int32_t reply = slot;
+    int64_t period;
+    int fds[3];
+    void* map;
+
+    if (read(mSocks[slot], &period, sizeof(period)) != sizeof(period)) {
+        drop(slot);
+        return false;
+    }
+    if (period < AMI602_MIN_DELAY_NS)
+        period = AMI602_MIN_DELAY_NS;
+    if (period > AMI602_MAX_DELAY_NS)
+        period = AMI602_MAX_DELAY_NS;
+
+    mEventFds[slot] = eventfd(0, 0);
+    mSlotFds[slot] = ashmem_create_region("bc10-sensors-client",
+            sizeof(struct ami602_channel_slot));
+    if (mEventFds[slot] < 0 || mSlotFds[slot] < 0) {
+        drop(slot);
+        return false;
+    }
+    map = mmap(NULL, sizeof(struct ami602_channel_slot),
+            PROT_READ | PROT_WRITE, MAP_SHARED, mSlotFds[slot], 0);
+    if (map == MAP_FAILED) {
+        drop(slot);
+        return false;
+    }
+    mSlots[slot] = (struct ami602_channel_slot*)map;
+    memset(mSlots[slot], 0, sizeof(*mSlots[slot]));
+
+    fds[0] = mShmFd;
+    fds[1] = mSlotFds[slot];
+    fds[2] = mEventFds[slot];
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &reply;
+    iov.iov_len = sizeof(reply);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(mSocks[slot], &msg, 0) != sizeof(reply)) {
+        drop(slot);
+        return false;
+    }
+    mPeriods[slot] = period;
+    mNumRegistered++;
+    return true;
+}
+
+void Ami602ChannelServer::drop(int slot)
+{
+    if (mPeriods[slot]) {
+        mPeriods[slot] = 0;
+        mNumRegistered--;
+    }
+    if (mEventFds[slot] >= 0) {
+        close(mEventFds[slot]);
+        mEventFds[slot] = -1;
+    }
+    if (mSlots[slot]) {
+        munmap(mSlots[slot], sizeof(*mSlots[slot]));
+        mSlots[slot] = NULL;
+    }
+    if (mSlotFds[slot] >= 0) {
+        close(mSlotFds[slot]);
+        mSlotFds[slot] = -1;
+    }
+    if (mSocks[slot] >= 0) {
+        close(mSocks[slot]);
+        mSocks[slot] = -1;
+    }
+}
+
+int64_t Ami602ChannelServer::period() const
+{
+    int64_t period = 0;
+
+    for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++) {
+        if (mPeriods[i] && (!period || mPeriods[i] < period))
+            period = mPeriods[i];
+    }
+    return period;
+}
+
+/*
+ * Claims the slots, writes the records, then publishes them; see
+ * ami602_channel_read() for the other half. Clients that asked to be
+ * woken get one eventfd signal.
+ */
+void Ami602ChannelServer::publish(const struct ami602_sample* recs, int count)
+{
+    const uint32_t slots = AMI602_CHANNEL_SLOTS;
+    uint32_t head, first, n;
+
+    if (!mNumRegistered)
+        return;
+
+    head = (uint32_t)mChannel->head;
+    android_atomic_acquire_store((int32_t)(head + count), &mChannel->claim);
+
+    first = head % slots;
+    n = (uint32_t)count < slots - first ? (uint32_t)count : slots - first;
+    memcpy(&mChannel->recs[first], recs, n * sizeof(*recs));
+    memcpy(&mChannel->recs[0], recs + n, (count - n) * sizeof(*recs));
+
+    android_atomic_release_store((int32_t)(head + count), &mChannel->head);
+
+    for (int i = 0; i < AMI602_CHANNEL_CLIENTS; i++) {
+        uint64_t one = 1;
+
+        if (mPeriods[i] &&
+                android_atomic_release_cas(1, 0, &mSlots[i]->waiting) == 0)
+            write(mEventFds[i], &one, sizeof(one));
+    }
+}
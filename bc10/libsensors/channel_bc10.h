@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_CHANNEL_BC10_H
+#define ANDROID_SENSORS_CHANNEL_BC10_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cutils/atomic.h>
+#include <cutils/sockets.h>
+
+#include "ami602.h"
+
+/*****************************************************************************/
+
+/*
+ * Direct channel to raw AMI602 samples for native processes, bypassing
+ * the framework.
+ *
+ * The HAL's sampler writes every sample once into a shared-memory ring,
+ * struct ami602_channel, that any number of clients read with their own
+ * cursor. A client connects to the abstract socket AMI602_CHANNEL_SOCKET
+ * and sends the sampling period it wants, in ns, as an int64_t; while it
+ * stays connected the AMI602 runs at least that fast, as if it had a
+ * handle enabled. The reply is its client slot as an int32_t, with three
+ * fds attached (SCM_RIGHTS): the ring's ashmem, which can only be mapped
+ * read-only, the client's own struct ami602_channel_slot, which it maps
+ * read-write, and its wakeup eventfd. The eventfd is only signalled when
+ * the client asked to be woken in its slot, so clients that keep up cost
+ * the producer nothing beyond the ring write. A client can corrupt its
+ * own slot, but not the ring or anyone else's.
+ *
+ * The channel is served while AMI602_CHANNEL_PROPERTY is "1", to root and
+ * to the HAL's own uid. Records are struct ami602_sample, converted with
+ * ami602_convert() like the HAL does.
+ */
+#define AMI602_CHANNEL_PROPERTY "sensors.bc10.channel"
+#define AMI602_CHANNEL_SOCKET   "bc10.sensors"
+#define AMI602_CHANNEL_MAGIC    0x32484341      // "ACH2"
+#define AMI602_CHANNEL_SLOTS    2048            // power of two
+#define AMI602_CHANNEL_CLIENTS  8
+
+// Shared between the HAL and one client, in an ashmem region of its own.
+struct ami602_channel_slot {
+    volatile int32_t waiting;   // client asks for an eventfd signal
+    int32_t reserved[15];
+};
+
+/*
+ * The producer bumps claim before overwriting any record and head once
+ * the records are in place. Both count records since the channel was
+ * created and wrap at 2^32; record n lives in recs[n % slots].
+ */
+struct ami602_channel {
+    uint32_t magic;
+    uint32_t slots;
+    uint32_t record_size;
+    uint32_t reserved0;
+    volatile int32_t head;
+    volatile int32_t claim;
+    int32_t reserved1[10];
+    struct ami602_sample recs[AMI602_CHANNEL_SLOTS];
+};
+
+/*****************************************************************************/
+
+/*
+ * Client side. Typical use:
+ *
+ *     struct ami602_channel_reader r;
+ *     ami602_channel_connect(&r, 10000000);       // 100 Hz
+ *     for (;;) {
+ *         n = ami602_channel_read(&r, recs, 64);
+ *         if (!n)
+ *             ami602_channel_wait(&r, -1);
+ *     }
+ */
+struct ami602_channel_reader {
+    int sock;
+    int efd;
+    int slot;
+    const struct ami602_channel* ch;
+    struct ami602_channel_slot* wake;
+    uint32_t cursor;
+    uint32_t lost;              // records overwritten before they were read
+};
+
+static inline int ami602_channel_connect(struct ami602_channel_reader* r,
+        int64_t period)
+{
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    int32_t slot;
+    int fds[3];
+    void* map;
+    void* wake;
+
+    memset(r, 0, sizeof(*r));
+    r->sock = socket_local_client(AMI602_CHANNEL_SOCKET,
+            ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
+    if (r->sock < 0)
+        return -errno;
+    if (write(r->sock, &period, sizeof(period)) != sizeof(period))
+        goto fail;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &slot;
+    iov.iov_len = sizeof(slot);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(r->sock, &msg, 0) != sizeof(slot) || slot < 0)
+        goto fail;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        goto fail;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    map = mmap(NULL, sizeof(struct ami602_channel), PROT_READ, MAP_SHARED,
+            fds[0], 0);
+    wake = mmap(NULL, sizeof(struct ami602_channel_slot),
+            PROT_READ | PROT_WRITE, MAP_SHARED, fds[1], 0);
+    close(fds[0]);
+    close(fds[1]);
+    r->efd = fds[2];
+    if (map == MAP_FAILED || wake == MAP_FAILED ||
+            ((struct ami602_channel*)map)->magic != AMI602_CHANNEL_MAGIC ||
+            ((struct ami602_channel*)map)->record_size !=
+                    sizeof(struct ami602_sample)) {
+        if (map != MAP_FAILED)
+            munmap(map, sizeof(struct ami602_channel));
+        if (wake != MAP_FAILED)
+            munmap(wake, sizeof(struct ami602_channel_slot));
+        close(r->efd);
+        goto fail;
+    }
+    r->ch = (const struct ami602_channel*)map;
+    r->wake = (struct ami602_channel_slot*)wake;
+    r->slot = slot;
+    r->cursor = (uint32_t)android_atomic_acquire_load(&r->ch->head);
+    return 0;
+
+fail:
+    close(r->sock);
+    r->sock = -1;
+    return -EPROTO;
+}
+
+static inline void ami602_channel_close(struct ami602_channel_reader* r)
+{
+    if (r->ch)
+        munmap((void*)r->ch, sizeof(struct ami602_channel));
+    if (r->wake)
+        munmap(r->wake, sizeof(struct ami602_channel_slot));
+    if (r->efd >= 0)
+        close(r->efd);
+    if (r->sock >= 0)
+        close(r->sock);
+    r->ch = NULL;
+    r->wake = NULL;
+    r->efd = r->sock = -1;
+}
+
+/*
+ * Copies up to max unread records, oldest first, and returns how many.
+ * Records the producer overwrote before they could be copied are skipped
+ * and counted in lost.
+ */
+static inline int ami602_channel_read(struct ami602_channel_reader* r,
+        struct ami602_sample* out, int max)
+{
+    const uint32_t slots = AMI602_CHANNEL_SLOTS;
+    uint32_t head = (uint32_t)android_atomic_acquire_load(&r->ch->head);
+    uint32_t avail = head - r->cursor;
+    uint32_t oldest, skip, first, n;
+
+    if (avail > slots) {
+        r->lost += avail - slots;
+        r->cursor = head - slots;
+        avail = slots;
+    }
+    if (avail > (uint32_t)max)
+        avail = max;
+
+    first = r->cursor % slots;
+    n = avail < slots - first ? avail : slots - first;
+    memcpy(out, &r->ch->recs[first], n * sizeof(*out));
+    memcpy(out + n, &r->ch->recs[0], (avail - n) * sizeof(*out));
+
+    // Anything the producer has claimed since may have been torn.
+    oldest = (uint32_t)android_atomic_release_load(&r->ch->claim) - slots;
+    skip = (int32_t)(oldest - r->cursor) > 0 ? oldest - r->cursor : 0;
+    if (skip >= avail) {
+        r->lost += skip;
+        r->cursor += skip;
+        return 0;
+    }
+    if (skip) {
+        memmove(out, out + skip, (avail - skip) * sizeof(*out));
+        r->lost += skip;
+    }
+    r->cursor += avail;
+    return avail - skip;
+}
+
+/*
+ * Blocks until unread records may be available or timeout_ms passes.
+ * Returns 0, or -EPIPE once the HAL has gone away.
+ */
+static inline int ami602_channel_wait(struct ami602_channel_reader* r,
+        int timeout_ms)
+{
+    struct pollfd fds[2];
+    uint64_t count;
+
+    android_atomic_acquire_store(1, &r->wake->waiting);
+    if ((uint32_t)android_atomic_acquire_load(&r->ch->head) != r->cursor)
+        return 0;
+
+    fds[0].fd = r->efd;
+    fds[0].events = POLLIN;
+    fds[1].fd = r->sock;
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, timeout_ms) < 0 && errno != EINTR)
+        return -errno;
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+        return -EPIPE;
+    if (fds[0].revents & POLLIN)
+        read(r->efd, &count, sizeof(count));
+    return 0;
+}
+
+/*****************************************************************************/
+
+#ifdef __cplusplus
+
+/*
+ * HAL side, run on the sampler thread: owns the ring, the listening
+ * socket and each client's slot, and tracks the period every connected
+ * client asked for.
+ */
+class Ami602ChannelServer {
+public:
+    Ami602ChannelServer();
+    ~Ami602ChannelServer();
+
+    int open();
+
+    // Fills fds with the sockets to watch and returns how many; at most
+    // MAX_POLL_FDS.
+    int pollFds(struct pollfd* fds) const;
+    // Services those fds after poll(). Returns true if period() changed.
+    bool handle(const struct pollfd* fds, int count);
+
+    // Fastest period any client asked for, or 0 without clients.
+    int64_t period() const;
+
+    void publish(const struct ami602_sample* recs, int count);
+
+    enum { MAX_POLL_FDS = 1 + AMI602_CHANNEL_CLIENTS };
+
+private:
+    bool accept();
+    bool registerClient(int slot);
+    void drop(int slot);
+
+    int mShmFd;
+    struct ami602_channel* mChannel;
+    int mListenFd;
+    int mSocks[AMI602_CHANNEL_CLIENTS];
+    int mEventFds[AMI602_CHANNEL_CLIENTS];
+    int mSlotFds[AMI602_CHANNEL_CLIENTS];
+    struct ami602_channel_slot* mSlots[AMI602_CHANNEL_CLIENTS];
+    int64_t mPeriods[AMI602_CHANNEL_CLIENTS];   // 0 until registered
+    int mNumRegistered;
+};
+
+#endif  // __cplusplus
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_CHANNEL_BC10_H
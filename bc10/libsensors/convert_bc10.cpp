@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <math.h>
+
+#include "convert_bc10.h"
+
+/*****************************************************************************/
+
+/*
+ * Original formula for the accelerometer:
+ *     x = ((accel_x - 2048) * GRAVITY_EARTH * -1.0) / 800.0
+ *     y = ((accel_y - 2048) * GRAVITY_EARTH) / 800.0
+ *     z = ((accel_z - 2048) * GRAVITY_EARTH * -1.0) / 800.0
+ * folded into one multiply-add per axis. The magnetometer reads
+ * 1 gauss = 600, i.e. 1 uT = 6 counts around 2048.
+ */
+#define ACCEL_SCALE     0.01225f
+#define ACCEL_OFFSET    25.1f
+#define MAG_BIAS        2048
+#define MAG_SCALE       (1.0f / 6.0f)
+
+void ami602_default_coeffs(struct ami602_coeffs* c)
+{
+    static const struct ami602_coeffs defaults = {
+        { 0, 0, 0, MAG_BIAS, MAG_BIAS, MAG_BIAS },
+        { -ACCEL_SCALE, ACCEL_SCALE, -ACCEL_SCALE,
+                MAG_SCALE, MAG_SCALE, MAG_SCALE },
+        { ACCEL_OFFSET, -ACCEL_OFFSET, ACCEL_OFFSET, 0.0f, 0.0f, 0.0f },
+    };
+    *c = defaults;
+}
+
+/*
+ * Every output is offset + (float)(raw - bias) * scale, rounded after the
+ * multiply and again after the add, so the scalar and NEON paths agree
+ * bit for bit.
+ */
+void ami602_convert_scalar(const struct ami602_sample* recs, int count,
+        const struct ami602_coeffs* c, struct ami602_vec* out)
+{
+    for (int i = 0; i < count; i++) {
+        const int32_t* raw = (const int32_t*)&recs[i].pos;
+        float* v = out[i].accel;        // accel and mag are contiguous
+
+        for (int k = 0; k < 6; k++)
+            v[k] = c->offset[k] + (float)(raw[k] - c->bias[k]) * c->scale[k];
+    }
+}
+
+#if defined(__ARM_NEON__)
+
+/*
+ * The six channels of a position are contiguous, so each sample is one
+ * quad (accel x, y, z, mag x) and one double (mag y, z) register: two
+ * loads, one integer bias, two converts, two multiply-adds and two stores.
+ */
+void ami602_convert(const struct ami602_sample* recs, int count,
+        const struct ami602_coeffs* c, struct ami602_vec* out)
+{
+    const int32x4_t b0 = vld1q_s32(c->bias);
+    const float32x4_t s0 = vld1q_f32(c->scale);
+    const float32x4_t o0 = vld1q_f32(c->offset);
+    const int32x2_t b1 = vld1_s32(c->bias + 4);
+    const float32x2_t s1 = vld1_f32(c->scale + 4);
+    const float32x2_t o1 = vld1_f32(c->offset + 4);
+
+    for (int i = 0; i < count; i++) {
+        const int32_t* raw = (const int32_t*)&recs[i].pos;
+        int32x4_t r0 = vsubq_s32(vld1q_s32(raw), b0);
+        int32x2_t r1 = vsub_s32(vld1_s32(raw + 4), b1);
+
+        vst1q_f32(out[i].accel, vmlaq_f32(o0, vcvtq_f32_s32(r0), s0));
+        vst1_f32(&out[i].mag[1], vmla_f32(o1, vcvt_f32_s32(r1), s1));
+    }
+}
+
+#else
+
+void ami602_convert(const struct ami602_sample* recs, int count,
+        const struct ami602_coeffs* c, struct ami602_vec* out)
+{
+    ami602_convert_scalar(recs, count, c, out);
+}
+
+#endif
+
+/*****************************************************************************/
+
+/*
+ * atan2 by octant reduction: a = min(|x|, |y|) / max(|x|, |y|) lies in
+ * [0, 1], where atan(a) is approximated by the odd polynomial of
+ * Abramowitz & Stegun 4.4.49 (|error| <= 1e-5 rad). The result is then
+ * reflected into the right octant and scaled to degrees.
+ */
+#define ATAN_C1         0.9998660f
+#define ATAN_C3         -0.3302995f
+#define ATAN_C5         0.1801410f
+#define ATAN_C7         -0.0851330f
+#define ATAN_C9         0.0208351f
+#define RAD_TO_DEG      57.29577951f
+
+float ami602_atan2_deg(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    float a, s, r;
+
+    if (mx == 0.0f)
+        return 0.0f;
+
+    a = mn / mx;
+    s = a * a;
+    r = a * (ATAN_C1 + s * (ATAN_C3 + s * (ATAN_C5 + s * (ATAN_C7 +
+            s * ATAN_C9))));
+
+    if (ay > ax)
+        r = (float)M_PI_2 - r;
+    if (x < 0.0f)
+        r = (float)M_PI - r;
+    if (y < 0.0f)
+        r = -r;
+    return r * RAD_TO_DEG;
+}
+
+void ami602_orient_scalar(const struct ami602_vec* in, int count,
+        struct ami602_orientation* out)
+{
+    for (int i = 0; i < count; i++) {
+        out[i].azimuth = ami602_atan2_deg(-in[i].mag[1], in[i].mag[0]) + 180;
+        out[i].pitch = ami602_atan2_deg(-in[i].accel[1], in[i].accel[2]);
+        out[i].roll = ami602_atan2_deg(-in[i].accel[0], in[i].accel[2]);
+    }
+}
+
+#if defined(__ARM_NEON__)
+
+/*
+ * Four atan2 evaluations at once. The division is a reciprocal estimate
+ * refined by two Newton-Raphson steps; max(|x|, |y|) == 0 yields 0 like
+ * the scalar path.
+ */
+static inline float32x4_t atan2_deg_neon(float32x4_t y, float32x4_t x)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t ax = vabsq_f32(x);
+    float32x4_t ay = vabsq_f32(y);
+    float32x4_t mx = vmaxq_f32(ax, ay);
+    float32x4_t mn = vminq_f32(ax, ay);
+    float32x4_t inv, a, s, r;
+
+    inv = vrecpeq_f32(mx);
+    inv = vmulq_f32(vrecpsq_f32(mx, inv), inv);
+    inv = vmulq_f32(vrecpsq_f32(mx, inv), inv);
+    a = vbslq_f32(vcgtq_f32(mx, zero), vmulq_f32(mn, inv), zero);
+
+    s = vmulq_f32(a, a);
+    r = vmlaq_f32(vdupq_n_f32(ATAN_C7), s, vdupq_n_f32(ATAN_C9));
+    r = vmlaq_f32(vdupq_n_f32(ATAN_C5), s, r);
+    r = vmlaq_f32(vdupq_n_f32(ATAN_C3), s, r);
+    r = vmlaq_f32(vdupq_n_f32(ATAN_C1), s, r);
+    r = vmulq_f32(a, r);
+
+    r = vbslq_f32(vcgtq_f32(ay, ax),
+            vsubq_f32(vdupq_n_f32((float)M_PI_2), r), r);
+    r = vbslq_f32(vcltq_f32(x, zero),
+            vsubq_f32(vdupq_n_f32((float)M_PI), r), r);
+    r = vbslq_f32(vcltq_f32(y, zero), vnegq_f32(r), r);
+    return vmulq_f32(r, vdupq_n_f32(RAD_TO_DEG));
+}
+
+void ami602_orient(const struct ami602_vec* in, int count,
+        struct ami602_orientation* out)
+{
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        float my[4], mx[4], ay[4], ax[4], az[4];
+        float az_out[4], pitch[4], roll[4];
+
+        for (int k = 0; k < 4; k++) {
+            my[k] = -in[i + k].mag[1];
+            mx[k] = in[i + k].mag[0];
+            ax[k] = -in[i + k].accel[0];
+            ay[k] = -in[i + k].accel[1];
+            az[k] = in[i + k].accel[2];
+        }
+
+        float32x4_t z = vld1q_f32(az);
+        vst1q_f32(az_out, vaddq_f32(
+                atan2_deg_neon(vld1q_f32(my), vld1q_f32(mx)),
+                vdupq_n_f32(180.0f)));
+        vst1q_f32(pitch, atan2_deg_neon(vld1q_f32(ay), z));
+        vst1q_f32(roll, atan2_deg_neon(vld1q_f32(ax), z));
+
+        for (int k = 0; k < 4; k++) {
+            out[i + k].azimuth = az_out[k];
+            out[i + k].pitch = pitch[k];
+            out[i + k].roll = roll[k];
+        }
+    }
+    ami602_orient_scalar(in + i, count - i, out + i);
+}
+
+#else
+
+void ami602_orient(const struct ami602_vec* in, int count,
+        struct ami602_orientation* out)
+{
+    ami602_orient_scalar(in, count, out);
+}
+
+#endif
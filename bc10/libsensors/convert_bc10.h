@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_CONVERT_BC10_H
+#define ANDROID_SENSORS_CONVERT_BC10_H
+
+#include <stdint.h>
+#include "ami602.h"
+
+/*****************************************************************************/
+
+/*
+ * One AMI602 sample in SI units, in the Android sensor frame:
+ * acceleration in m/s^2 and magnetic field in uT.
+ */
+struct ami602_vec {
+    float accel[3];
+    float mag[3];
+};
+
+/*
+ * Per-channel conversion, in ami602_position order (accel x, y, z, then
+ * mag x, y, z): value = offset + (raw - bias) * scale. The defaults are
+ * the AMI602 datasheet conversion; calibration folds its corrections into
+ * scale and offset, so calibrated output costs nothing extra.
+ */
+struct ami602_coeffs {
+    int32_t bias[6];
+    float scale[6];
+    float offset[6];
+};
+
+void ami602_default_coeffs(struct ami602_coeffs* c);
+
+/*
+ * Converts count raw samples. Uses NEON when the target has it and
+ * ami602_convert_scalar() otherwise; both produce identical results.
+ */
+void ami602_convert(const struct ami602_sample* recs, int count,
+        const struct ami602_coeffs* c, struct ami602_vec* out);
+
+// Portable reference implementation.
+void ami602_convert_scalar(const struct ami602_sample* recs, int count,
+        const struct ami602_coeffs* c, struct ami602_vec* out);
+
+/*
+ * Orientation in degrees, derived from one converted sample:
+ *     azimuth = atan2(-mag.y, mag.x) + 180
+ *     pitch   = atan2(-accel.y, accel.z)
+ *     roll    = atan2(-accel.x, accel.z)
+ */
+struct ami602_orientation {
+    float azimuth;
+    float pitch;
+    float roll;
+};
+
+/*
+ * Upper bound on |ami602_atan2_deg(y, x) - atan2(y, x) * 180 / pi|, modulo
+ * 360, over all finite inputs. The polynomial alone is good to 1e-5 rad
+ * (0.00057 degrees); the rest is float rounding and, on NEON, the
+ * reciprocal estimate. The NEON path of ami602_orient() meets it where
+ * |x| and |y| are each zero or normal and both are below 2^126: NEON
+ * flushes denormals to zero, and the reciprocal estimate of anything
+ * larger is zero. Converted samples are far inside that range.
+ */
+#define AMI602_ATAN2_MAX_ERROR_DEG  0.001f
+
+// atan2 in degrees, in (-180, 180]. atan2(0, 0) is 0.
+float ami602_atan2_deg(float y, float x);
+
+/*
+ * Computes the orientation of count converted samples, four at a time
+ * with NEON when available.
+ */
+void ami602_orient(const struct ami602_vec* in, int count,
+        struct ami602_orientation* out);
+
+// Portable reference implementation.
+void ami602_orient_scalar(const struct ami602_vec* in, int count,
+        struct ami602_orientation* out);
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_CONVERT_BC10_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "filter_bc10.h"
+
+/*****************************************************************************/
+
+Decimator::Decimator()
+    : mBypass(true), mPrimed(false),
+      mB0(1), mB1(0), mB2(0), mA1(0), mA2(0),
+      mOutPeriod(0), mSlack(0), mNext(0)
+{
+}
+
+/*
+ * Bilinear-transform design of the Butterworth section, with the cutoff at
+ * the given fraction of the output Nyquist frequency.
+ */
+void Decimator::configure(int64_t inPeriod, int64_t outPeriod, float cutoff)
+{
+    mOutPeriod = outPeriod;
+    mSlack = inPeriod / 2;
+    mBypass = outPeriod <= inPeriod || cutoff <= 0;
+
+    if (!mBypass) {
+        const float q = (float)M_SQRT1_2;
+        float fc = cutoff * 0.5f / outPeriod;       // cycles per ns
+        float k = tanf((float)M_PI * fc * inPeriod);
+        float norm = 1 / (1 + k / q + k * k);
+
+        mB0 = k * k * norm;
+        mB1 = 2 * mB0;
+        mB2 = mB0;
+        mA1 = 2 * (k * k - 1) * norm;
+        mA2 = (1 - k / q + k * k) * norm;
+    }
+    reset();
+}
+
+void Decimator::reset()
+{
+    mPrimed = false;
+    mNext = 0;
+}
+
+bool Decimator::tick(int64_t t)
+{
+    if (t + mSlack < mNext)
+        return false;
+
+    mNext += mOutPeriod;
+    if (mNext <= t)
+        mNext = t + mOutPeriod;
+    return true;
+}
+
+bool Decimator::push(const float in[3], int64_t t, float out[3])
+{
+    bool due = tick(t);
+
+    if (mBypass) {
+        if (due) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        }
+        return due;
+    }
+
+    // Start from the steady state for the first input, so the filter has
+    // no start-up transient.
+    if (!mPrimed) {
+        for (int i = 0; i < 3; i++) {
+            mZ1[i] = in[i] * (1 - mB0);
+            mZ2[i] = in[i] * (mB2 - mA2);
+        }
+        mPrimed = true;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        float y = mB0 * in[i] + mZ1[i];
+        mZ1[i] = mB1 * in[i] - mA1 * y + mZ2[i];
+        mZ2[i] = mB2 * in[i] - mA2 * y;
+        out[i] = y;
+    }
+    return due;
+}
+
+/*****************************************************************************/
+
+StillDetector::StillDetector()
+    : mThreshold(0), mHold(0)
+{
+    reset();
+}
+
+void StillDetector::configure(float threshold, int64_t hold)
+{
+    mThreshold = threshold;
+    mHold = hold;
+    reset();
+}
+
+void StillDetector::reset()
+{
+    mHead = 0;
+    mCount = 0;
+    for (int i = 0; i < 3; i++) {
+        mSum[i] = 0;
+        mSumSq[i] = 0;
+    }
+    mQuietSince = -1;
+    mStill = false;
+}
+
+/*
+ * The window keeps exact integer sums, so with n samples
+ *     n^2 * variance = n * sum(x^2) - sum(x)^2
+ *     n^2 * distance = (n * x - sum(x))^2
+ * and both tests run without a division.
+ */
+bool StillDetector::update(const int accel[3], int64_t t)
+{
+    const int64_t n = mCount;
+    int64_t dist = 0;
+    int64_t var = 0;
+    int* slot;
+
+    for (int i = 0; i < 3 && n; i++) {
+        int64_t d = n * accel[i] - mSum[i];
+        dist += d * d;
+    }
+    if (n && (float)dist > MOTION_GATE * mThreshold * (float)(n * n)) {
+        reset();
+    }
+
+    slot = mSamples[mHead];
+    if (mCount == WINDOW) {
+        for (int i = 0; i < 3; i++) {
+            mSum[i] -= slot[i];
+            mSumSq[i] -= (int64_t)slot[i] * slot[i];
+        }
+    } else {
+        mCount++;
+    }
+    for (int i = 0; i < 3; i++) {
+        slot[i] = accel[i];
+        mSum[i] += accel[i];
+        mSumSq[i] += (int64_t)accel[i] * accel[i];
+    }
+    mHead = (mHead + 1) % WINDOW;
+
+    if (mCount < WINDOW)
+        return mStill;
+
+    for (int i = 0; i < 3; i++)
+        var += WINDOW * mSumSq[i] - mSum[i] * mSum[i];
+    if ((float)var > mThreshold * (WINDOW * WINDOW)) {
+        mQuietSince = -1;
+        mStill = false;
+    } else if (mQuietSince < 0) {
+        mQuietSince = t;
+    } else if (t - mQuietSince >= mHold) {
+        mStill = true;
+    }
+    return mStill;
+}
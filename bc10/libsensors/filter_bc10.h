@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_FILTER_BC10_H
+#define ANDROID_SENSORS_FILTER_BC10_H
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/*
+ * Anti-alias cutoff as a fraction of the output Nyquist frequency; 0 turns
+ * the low-pass off and decimation just picks samples.
+ */
+#define AMI602_LPF_PROPERTY     "sensors.bc10.lpf"
+#define AMI602_LPF_DEFAULT      "0.8"
+
+/*
+ * Brings a three-channel stream sampled every inPeriod down to one output
+ * every outPeriod. Inputs go through a second-order Butterworth low-pass
+ * (direct form II transposed) cut off below the output Nyquist frequency,
+ * and an output is due whenever outPeriod has elapsed since the last one.
+ * Deciding by time rather than by sample count keeps the output rate right
+ * when the input rate changes underneath it.
+ *
+ * When outPeriod is not longer than inPeriod every input is passed through
+ * unfiltered.
+ */
+class Decimator {
+public:
+    Decimator();
+
+    void configure(int64_t inPeriod, int64_t outPeriod, float cutoff);
+    void reset();
+
+    // Filters one input taken at time t. Returns true, with the filtered
+    // value in out, when an output is due.
+    bool push(const float in[3], int64_t t, float out[3]);
+
+    // Like push() for a stream that is not filtered here: only tells
+    // whether an output is due at time t.
+    bool tick(int64_t t);
+
+private:
+    bool mBypass;
+    bool mPrimed;
+    float mB0, mB1, mB2, mA1, mA2;
+    float mZ1[3], mZ2[3];
+    int64_t mOutPeriod;
+    int64_t mSlack;
+    int64_t mNext;
+};
+
+/*
+ * Tells a still device from a moving one by the variance of the last
+ * WINDOW raw accelerometer samples, summed over the axes, in counts^2.
+ * The device is still once that has stayed at or below the threshold for
+ * hold ns, and moving again as soon as one sample strays from the window
+ * mean by more than MOTION_GATE times the threshold (squared distance),
+ * or the variance itself exceeds it. Works at any input rate, so the
+ * same samples that are taken while idling can end the idle.
+ */
+class StillDetector {
+public:
+    enum { WINDOW = 16, MOTION_GATE = 4 };
+
+    StillDetector();
+
+    void configure(float threshold, int64_t hold);
+    void reset();
+
+    // Feeds one sample taken at time t; returns true while still.
+    bool update(const int accel[3], int64_t t);
+
+private:
+    float mThreshold;       // counts^2
+    int64_t mHold;
+    int mSamples[WINDOW][3];
+    int mHead;
+    int mCount;
+    int64_t mSum[3];
+    int64_t mSumSq[3];
+    int64_t mQuietSince;    // -1 while the window is noisy
+    bool mStill;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_FILTER_BC10_H
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "fusion_bc10.h"
+
+/*****************************************************************************/
+
+Fusion::Fusion()
+{
+    reset();
+}
+
+void Fusion::reset()
+{
+    mPrimed = false;
+    mLast = 0;
+    mQuat[0] = mQuat[1] = mQuat[2] = 0;
+    mQuat[3] = 1;
+}
+
+/*
+ * First-order low-pass with the gain worked out from the actual sample
+ * spacing, so the time constants hold whatever rate the device runs at.
+ */
+void Fusion::update(const struct ami602_vec& v, int64_t t)
+{
+    float dt, ga, fa;
+
+    if (!mPrimed) {
+        for (int i = 0; i < 3; i++) {
+            mGravity[i] = v.accel[i];
+            mField[i] = v.mag[i];
+        }
+        mLast = t;
+        mPrimed = true;
+        return;
+    }
+
+    dt = (float)(t - mLast);
+    mLast = t;
+    ga = dt / (GRAVITY_TAU_NS + dt);
+    fa = dt / (FIELD_TAU_NS + dt);
+    for (int i = 0; i < 3; i++) {
+        mGravity[i] += ga * (v.accel[i] - mGravity[i]);
+        mField[i] += fa * (v.mag[i] - mField[i]);
+    }
+}
+
+void Fusion::gravity(float out[3]) const
+{
+    out[0] = mGravity[0];
+    out[1] = mGravity[1];
+    out[2] = mGravity[2];
+}
+
+void Fusion::linear(const float accel[3], float out[3]) const
+{
+    out[0] = accel[0] - mGravity[0];
+    out[1] = accel[1] - mGravity[1];
+    out[2] = accel[2] - mGravity[2];
+}
+
+void Fusion::rotation(float out[4])
+{
+    const float* a = mGravity;
+    const float* e = mField;
+    float h[3], m[3], normH, invA;
+    float r00, r01, r02, r10, r11, r12, r20, r21, r22;
+
+    // East is the field crossed with up, north is up crossed with east.
+    h[0] = e[1] * a[2] - e[2] * a[1];
+    h[1] = e[2] * a[0] - e[0] * a[2];
+    h[2] = e[0] * a[1] - e[1] * a[0];
+    normH = sqrtf(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+
+    if (normH >= 0.1f) {
+        invA = 1 / sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        normH = 1 / normH;
+        r00 = h[0] * normH; r01 = h[1] * normH; r02 = h[2] * normH;
+        r20 = a[0] * invA;  r21 = a[1] * invA;  r22 = a[2] * invA;
+        m[0] = r21 * r02 - r22 * r01;
+        m[1] = r22 * r00 - r20 * r02;
+        m[2] = r20 * r01 - r21 * r00;
+        r10 = m[0]; r11 = m[1]; r12 = m[2];
+
+        // Rotation matrix to quaternion, one component per diagonal
+        // combination, signs from the off-diagonal differences.
+        mQuat[3] = 0.5f * sqrtf(fmaxf(0, 1 + r00 + r11 + r22));
+        mQuat[0] = copysignf(0.5f * sqrtf(fmaxf(0, 1 + r00 - r11 - r22)),
+                r21 - r12);
+        mQuat[1] = copysignf(0.5f * sqrtf(fmaxf(0, 1 - r00 + r11 - r22)),
+                r02 - r20);
+        mQuat[2] = copysignf(0.5f * sqrtf(fmaxf(0, 1 - r00 - r11 + r22)),
+                r10 - r01);
+    }
+
+    out[0] = mQuat[0];
+    out[1] = mQuat[1];
+    out[2] = mQuat[2];
+    out[3] = mQuat[3];
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_FUSION_BC10_H
+#define ANDROID_SENSORS_FUSION_BC10_H
+
+#include <stdint.h>
+#include "convert_bc10.h"
+
+/*****************************************************************************/
+
+/*
+ * Gravity, linear acceleration and rotation vector, derived from the
+ * converted accelerometer and magnetometer stream.
+ *
+ * update() runs once per sample and only low-passes both vectors: gravity
+ * is the accelerometer averaged over GRAVITY_TAU_NS, and the field is
+ * smoothed over FIELD_TAU_NS to take the noise out of the heading. The
+ * outputs are derived from that state on demand, so each costs nothing
+ * until an event is actually due. The rotation vector comes from the
+ * TRIAD attitude of gravity and the field, as in
+ * SensorManager.getRotationMatrix(); when the two are close to parallel,
+ * or in free fall, the last good attitude is kept.
+ */
+class Fusion {
+public:
+    Fusion();
+
+    void reset();
+    void update(const struct ami602_vec& v, int64_t t);
+
+    void gravity(float out[3]) const;
+    void linear(const float accel[3], float out[3]) const;
+
+    // Unit quaternion rotating the device frame into the east-north-up
+    // world frame, as x, y, z, w.
+    void rotation(float out[4]);
+
+private:
+    enum {
+        GRAVITY_TAU_NS = 250000000,
+        FIELD_TAU_NS   = 100000000,
+    };
+
+    bool mPrimed;
+    int64_t mLast;
+    float mGravity[3];
+    float mField[3];
+    float mQuat[4];
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_FUSION_BC10_H
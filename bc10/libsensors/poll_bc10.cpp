@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -24,144 +25,1350 @@
 #include <errno.h>
 #include <string.h>
 #include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <cutils/native_handle.h>
 #include <cutils/sockets.h>
 
 #include <hardware/sensors.h>
 #include "ami602.h"
 #include "poll_bc10.h"
-
-static float one_rad = 180 / M_PI;
+#include "convert_bc10.h"
+#include "filter_bc10.h"
+#include "fusion_bc10.h"
+#include "calib_bc10.h"
+#include "channel_bc10.h"
+#include "ring_bc10.h"
+#include "seqlock_bc10.h"
+#include "source_bc10.h"
+#include "record_bc10.h"
+#include "stats_bc10.h"
 
 /*****************************************************************************/
 
 /*
  * Poll context
+ *
+ * A dedicated sampler thread owns the AMI602: it waits for the sampling
+ * timer, reads one position and pushes it, timestamped, into mRing.
+ * pollEvents() runs on the framework's poll thread and drains the ring in
+ * bulk, converting a whole batch of records at once. Each enabled handle
+ * then low-passes and decimates the shared stream down to its own rate,
+ * so a slow consumer gets clean values and costs only its own outputs.
+ * The two sides only meet at the lock-free ring and at mPollFd, an eventfd
+ * the sampler signals once a batch is due. Configuration from the binder
+ * threads reaches both through mConfig, a seqlock-published snapshot, so
+ * neither waits on a lock. The sampler alone opens, clocks and closes the
+ * source, applying each new snapshot as it sees it; a control call that
+ * changes sampling wakes it through mCtlFd and waits for the outcome.
+ * Calibration learned in pollEvents() goes the other way, through
+ * mCalibOut, for the sampler to save.
  */
 
 struct sensors_poll_context_t {
+#ifdef SENSORS_DEVICE_API_VERSION_1_1
+    struct sensors_poll_device_1 device; // must be first
+#else
     struct sensors_poll_device_t device; // must be first
+#endif
 
         sensors_poll_context_t();
         ~sensors_poll_context_t();
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
+    int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    int flush(int handle);
     int pollEvents(sensors_event_t* data, int count);
 
 private:
-    struct pollfd mPollFd;
-    int stat;
-    struct ami602_position pos;
+    enum { BATCH_READ = 64 };
+    enum { STATS_PERIOD_MS = 1000 };
+
+    // Besides the sensor handles, clients of the shared-memory channel
+    // keep the AMI602 running as one more, internal, handle.
+    enum { ID_CHANNEL = MAX_NUM_SENSORS, NUM_HANDLES };
+    enum { SENSOR_MASK = (1 << MAX_NUM_SENSORS) - 1 };
+
+    // Decimators: one per delivered vector. Orientation filters its own
+    // copies of both inputs, at its own rate. The rotation vector is only
+    // scheduled, as its inputs are already smoothed by Fusion.
+    enum { DEC_A, DEC_M, DEC_OA, DEC_OM, DEC_G, DEC_L, DEC_R, NUM_DECIMATORS };
+
+    struct pollfd mPollFd;          // data-ready eventfd, signalled by the sampler
     sensors_event_t event[MAX_NUM_SENSORS];
 
+    // Poll thread only: the batch being processed and the events produced
+    // from it but not yet delivered.
+    struct ami602_sample mBatch[BATCH_READ];
+    struct ami602_vec mVecs[BATCH_READ];
+    struct ami602_vec mOrientIn[BATCH_READ];
+    struct ami602_orientation mOrient[BATCH_READ];
+    int mOrientSlot[BATCH_READ];
+    sensors_event_t mEvents[BATCH_READ * MAX_NUM_SENSORS];
+    sensors_event_t* mEventEnd;     // while processing: next free event
+    int mNumOrient;                 // while processing: queued orientations
+
+    // Poll thread only: on-change suppression, for the handles in
+    // mSuppressMask. Values are compared against the last delivered event.
+    uint32_t mSuppressMask;
+    float mDeadband[MAX_NUM_SENSORS];
+    int64_t mMaxSilence[MAX_NUM_SENSORS];
+    int64_t mLastSent[MAX_NUM_SENSORS];     // timestamp, or -1 for none
+    float mLastValue[MAX_NUM_SENSORS][4];
+    int mEventPos;
+    int mEventLen;
+
+    // Poll thread only: decimation for the configuration of mSeenGen.
+    Decimator mDecimators[NUM_DECIMATORS];
+    int64_t mDecIn[MAX_NUM_SENSORS];
+    int64_t mDecOut[MAX_NUM_SENSORS];
+    uint32_t mSeenGen;
+    float mCutoff;
+    Fusion mFusion;
+    Calibrator mCalib;
+    bool mCalibLearn;
+
+    // Calibration learned by the poll thread, for the sampler to save at
+    // most every AMI602_CALIB_SAVE_MS.
+    Seqlock<ami602_coeffs> mCalibOut;
+    volatile int32_t mCalibGen;     // bumped after each mCalibOut write
+    int32_t mCalibSavedGen;         // sampler only
+    int64_t mCalibSaved;            // sampler only: time of the last save
+
+    SpscRing<ami602_sample, AMI602_RING_SIZE> mRing;
+    Ami602Stats mStats;
+
+    // What the control plane last asked for, as the sampler and
+    // pollEvents() see it. Published by whoever holds mLock.
+    struct Config {
+        uint32_t enabled;           // bit per handle
+        uint32_t generation;        // bumped on every publication
+        int64_t period;             // requested sampling period
+        int64_t latency;            // max report latency
+        int64_t delays[NUM_HANDLES];
+    };
+    Seqlock<Config> mConfig;
+
+    volatile int32_t mFlushPending; // bit per handle
+    volatile int32_t mClosing;      // close() is waiting for pollEvents()
+    volatile int32_t mPollers;      // pollEvents() calls in flight
+    pthread_cond_t mPollersDone;    // signalled, under mLock, when the last
+                                    // poller leaves after mClosing is set
+
+    // mLock serializes the control plane and guards the state below.
+    // pollEvents() never takes it; the sampler only does to report that
+    // it applied a new configuration.
+    pthread_mutex_t mLock;
+    uint32_t mEnabled;              // bit per handle
+    uint32_t mGeneration;
+    int64_t mDelays[NUM_HANDLES];
+    int64_t mLatencies[NUM_HANDLES];
+    int64_t mPeriod;        // requested sampling period
+    int64_t mLatency;       // max report latency across enabled handles
+    pthread_cond_t mApplied;        // signalled when mAppliedGen moves
+    uint32_t mAppliedGen;           // last generation the sampler applied
+    int mApplyErr;                  // what applying it returned
+    bool mSamplerRunning;
+
+    // Sampler only: the source and the sampling clock.
+    Ami602Source* mSource;
+    bool mSourceOpen;
+    bool mMeasuring;                // a triggered measurement is in flight
+    bool mStreaming;                // the source clocks itself
+    int mTimerFd;
+    int64_t mSamplePeriod;  // requested period, as last applied
+    int64_t mArmedPeriod;   // period the timer currently runs at
+    int64_t mArmedSince;    // when it started to, for mStats
+    bool mIdle;             // adaptive: sampling at mIdlePeriod
+
+    pthread_t mThread;
+    int mCtlFd;                     // wakes the sampler thread
+    volatile int32_t mExit;
+    int64_t mOldest;                // sampler only: oldest unsignalled record
+    int64_t mTriggerTime;           // sampler only: start of the measurement
+    Ami602Recorder* mRecorder;      // NULL unless recording
+    char mStatsPath[PROPERTY_VALUE_MAX];    // empty unless dumping mStats
+    int64_t mStatsDumped;           // sampler only
+    Ami602ChannelServer* mChannel;  // sampler only; NULL unless serving
+
+    // Motion-adaptive sampling, when AMI602_ADAPTIVE_PROPERTY is set.
+    bool mAdaptive;
+    int64_t mIdlePeriod;
+    StillDetector mStill;           // sampler only
+
     int64_t getTimeNano();
+    int readEvents(sensors_event_t* data, int count);
+    int activateLocked(int handle, int enabled);
+    void updatePeriod();
+    void publishConfig();
+    int waitApplied();
+    void applyConfig(const Config& config);
+    int64_t targetPeriod();
+    void setArmedPeriod(int64_t period);
+    int armTimer();
+    void disarmTimer();
+    int startSampling();
+    void stopSampling();
+    void wake(int fd);
+    int startSample(struct ami602_sample* rec);
+    void publish(const struct ami602_sample* recs, int count,
+            int64_t latency, bool toRing);
+    void updateChannel();
+    void adapt(const struct ami602_sample* recs, int count);
+    int saveCalib(bool force);
+    void configureDecimators(const Config& config);
+    // process() for every combination of enabled handles, indexed by
+    // the enabled mask, so the per-record loop has no handle tests.
+    typedef int (sensors_poll_context_t::*ProcessFn)(int count);
+    static ProcessFn sProcess[1 << MAX_NUM_SENSORS];
+    template<uint32_t Mask> static void fillProcess(ProcessFn* table);
+    static void initProcess();
+    template<uint32_t Mask> int process(int count);
+    template<int H> void emit(const struct ami602_vec& v, int64_t t);
+    void pushVec(int h, Decimator& dec, const float in[3], int64_t t);
+    void loadSuppression();
+    int suppress(int count);
+    void account(const sensors_event_t* data, int count);
+    void dumpStats();
+    void samplerLoop();
+    static void* samplerThread(void* arg);
+};
+
+#define BC10_SENSOR_TYPE(id, name, type, maxRange, resolution, power) type,
+
+static const int sTypes[MAX_NUM_SENSORS] = {
+    BC10_SENSORS(BC10_SENSOR_TYPE)
 };
 
 sensors_poll_context_t::sensors_poll_context_t()
 {
-    mPollFd.fd = open(AMI602_DEV, O_RDWR);
+    mPollFd.fd = eventfd(0, 0);
     mPollFd.events = POLLIN;
     mPollFd.revents = 0;
-    stat = 0;
+    mEventPos = 0;
+    mEventLen = 0;
+    mSeenGen = 0;
+    for (int i = 0; i < MAX_NUM_SENSORS; i++) {
+        mDecIn[i] = 0;
+        mDecOut[i] = 0;
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get(AMI602_LPF_PROPERTY, value, AMI602_LPF_DEFAULT);
+    mCutoff = atof(value);
+
+    if (mCalib.load(AMI602_CALIB_FILE) == 0)
+        LOGI("loaded calibration from %s", AMI602_CALIB_FILE);
+    property_get(AMI602_CALIB_PROPERTY, value, "1");
+    mCalibLearn = strcmp(value, "0") != 0;
+    mCalibGen = 0;
+    mCalibSavedGen = 0;
+    mCalibSaved = 0;
 
     memset(event, 0x0, sizeof(event));
 
-    event[0].version = sizeof(sensors_event_t);
-    event[0].sensor = ID_A;
-    event[0].type = SENSOR_TYPE_ACCELEROMETER;
-    event[0].acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    for (int h = 0; h < MAX_NUM_SENSORS; h++) {
+        event[h].version = sizeof(sensors_event_t);
+        event[h].sensor = h;
+        event[h].type = sTypes[h];
+        event[h].acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    }
+    initProcess();
+    loadSuppression();
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mPollersDone, NULL);
+    pthread_cond_init(&mApplied, NULL);
+    mAppliedGen = 0;
+    mApplyErr = 0;
+    mClosing = 0;
+    mPollers = 0;
+    mEnabled = 0;
+    mFlushPending = 0;
+    mGeneration = 0;
+    mSource = Ami602Source::create();
+    mSourceOpen = false;
+    mMeasuring = false;
+    mStreaming = false;
+    for (int i = 0; i < NUM_HANDLES; i++) {
+        mDelays[i] = AMI602_DEFAULT_DELAY_NS;
+        mLatencies[i] = 0;
+    }
+    mPeriod = AMI602_DEFAULT_DELAY_NS;
+    mSamplePeriod = 0;
+    mArmedPeriod = 0;
+    mArmedSince = 0;
+    mIdle = false;
+    mLatency = 0;
+    publishConfig();
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (mTimerFd < 0) {
+        LOGE("timerfd_create failed (%s)", strerror(errno));
+    }
+    mCtlFd = eventfd(0, 0);
+    if (mPollFd.fd < 0 || mCtlFd < 0) {
+        LOGE("eventfd failed (%s)", strerror(errno));
+    }
+
+    mExit = 0;
+    mOldest = -1;
+    mTriggerTime = 0;
+    mRecorder = Ami602Recorder::create();
+    property_get(AMI602_STATS_PROPERTY, mStatsPath, "");
+    mStatsDumped = 0;
+
+    mChannel = NULL;
+    property_get(AMI602_CHANNEL_PROPERTY, value, "0");
+    if (!strcmp(value, "1")) {
+        mChannel = new Ami602ChannelServer();
+        if (mChannel->open()) {
+            delete mChannel;
+            mChannel = NULL;
+        }
+    }
+
+    mAdaptive = property_get(AMI602_ADAPTIVE_PROPERTY, value, NULL) > 0;
+    if (mAdaptive) {
+        const char* idle = strchr(value, ',');
 
-    event[1].version = sizeof(sensors_event_t);
-    event[1].sensor = ID_M;
-    event[1].type = SENSOR_TYPE_MAGNETIC_FIELD;
-    event[1].acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+        mIdlePeriod = (idle ? atoll(idle + 1) : AMI602_ADAPTIVE_IDLE_MS) *
+                1000000LL;
+        mStill.configure(atof(value), AMI602_ADAPTIVE_HOLD_MS * 1000000LL);
+        LOGI("adaptive sampling: threshold %g, idle period %lld ms",
+                atof(value), (long long)(mIdlePeriod / 1000000));
+    }
 
-    event[2].version = sizeof(sensors_event_t);
-    event[2].sensor = ID_O;
-    event[2].type = SENSOR_TYPE_ORIENTATION;
-    event[2].acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    mSamplerRunning = true;
+    if (pthread_create(&mThread, NULL, samplerThread, this) != 0) {
+        LOGE("cannot create sampler thread");
+        mSamplerRunning = false;
+    }
 }
 
+/*
+ * Closing kicks any pollEvents() still blocked out of poll() and waits
+ * for it to leave before tearing anything down.
+ */
 sensors_poll_context_t::~sensors_poll_context_t() {
+    android_atomic_acquire_store(1, &mClosing);
+    wake(mPollFd.fd);
+    pthread_mutex_lock(&mLock);
+    while (android_atomic_acquire_load(&mPollers))
+        pthread_cond_wait(&mPollersDone, &mLock);
+    pthread_mutex_unlock(&mLock);
+
+    android_atomic_release_store(1, &mExit);
+    wake(mCtlFd);
+    pthread_join(mThread, NULL);
+    saveCalib(true);
+    if (mStatsPath[0])
+        mStats.dump(mStatsPath);
+
+    close(mCtlFd);
+    close(mTimerFd);
+    delete mSource;
+    delete mRecorder;
+    delete mChannel;
     close(mPollFd.fd);
+    pthread_cond_destroy(&mPollersDone);
+    pthread_cond_destroy(&mApplied);
+    pthread_mutex_destroy(&mLock);
 }
 
+/*
+ * The device is opened and the sampling timer started when the first
+ * handle is enabled, and both are torn down again with the last one,
+ * so an idle HAL neither wakes up nor touches the I2C bus. While the
+ * timer is disarmed the sampler thread stays blocked in poll().
+ */
 int sensors_poll_context_t::activate(int handle, int enabled) {
-#if 0
-    int err =  mSensors[index]->enable(handle, enabled);
-    if (enabled && !err) {
-        LOGE("error sending wake message (%s)", strerror(errno));
+    int err;
+
+    if (handle < 0 || handle >= MAX_NUM_SENSORS)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mLock);
+    err = activateLocked(handle, enabled);
+    pthread_mutex_unlock(&mLock);
+
+    // Have a blocked pollEvents() pick up the new set of handles now.
+    wake(mPollFd.fd);
+    return err;
+}
+
+/*
+ * Publishes the new set of handles and waits for the sampler to act on
+ * it. A handle the sampler could not start sampling for is disabled
+ * again. Called with mLock held.
+ */
+int sensors_poll_context_t::activateLocked(int handle, int enabled)
+{
+    int err;
+
+    if (enabled)
+        mEnabled |= 1 << handle;
+    else
+        mEnabled &= ~(1 << handle);
+    updatePeriod();
+    publishConfig();
+    err = waitApplied();
+
+    if (err && enabled) {
+        mEnabled &= ~(1 << handle);
+        updatePeriod();
+        publishConfig();
+        waitApplied();
     }
     return err;
-#else
-    return 0;
-#endif
 }
 
 int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
+    int err = 0;
+
+    if (handle < 0 || handle >= MAX_NUM_SENSORS)
+        return -EINVAL;
+
+    if (ns < AMI602_MIN_DELAY_NS)
+        ns = AMI602_MIN_DELAY_NS;
+    if (ns > AMI602_MAX_DELAY_NS)
+        ns = AMI602_MAX_DELAY_NS;
+
+    pthread_mutex_lock(&mLock);
+    mDelays[handle] = ns;
+    updatePeriod();
+    publishConfig();
+    if (mEnabled)
+        err = waitApplied();
+    pthread_mutex_unlock(&mLock);
+
+    wake(mPollFd.fd);
+    return err;
+}
+
+/*
+ * Sets the sampling period and how long samples may be held back before
+ * they are reported. Handles that tolerate latency let the sampler fill
+ * the ring, so pollEvents() wakes up once per batch rather than once per
+ * sample.
+ */
+int sensors_poll_context_t::batch(int handle, int flags,
+        int64_t period_ns, int64_t timeout) {
+    int err;
+
+    if (handle < 0 || handle >= MAX_NUM_SENSORS || timeout < 0)
+        return -EINVAL;
+#ifdef SENSORS_BATCH_DRY_RUN
+    if (flags & SENSORS_BATCH_DRY_RUN)
+        return 0;
+#endif
 
+    err = setDelay(handle, period_ns);
+    if (err)
+        return err;
+
+    pthread_mutex_lock(&mLock);
+    mLatencies[handle] = timeout;
+    updatePeriod();
+    publishConfig();
+    pthread_mutex_unlock(&mLock);
     return 0;
 }
 
+/*
+ * Delivers whatever is batched right away. With the 1.1 HAL the drain is
+ * terminated by a META_DATA_FLUSH_COMPLETE event for the handle.
+ */
+int sensors_poll_context_t::flush(int handle) {
+    if (handle < 0 || handle >= MAX_NUM_SENSORS)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mLock);
+    if (!(mEnabled & (1 << handle))) {
+        pthread_mutex_unlock(&mLock);
+        return -EINVAL;
+    }
+    pthread_mutex_unlock(&mLock);
+    android_atomic_or(1 << handle, &mFlushPending);
+
+    wake(mPollFd.fd);
+    return 0;
+}
+
+/*
+ * The AMI602 delivers all axes of all sensors in one transfer, so the
+ * device is sampled once at the fastest rate any enabled handle asked
+ * for, and batches are cut at the shortest latency any of them accepts.
+ * Called with mLock held.
+ */
+void sensors_poll_context_t::updatePeriod()
+{
+    int64_t period = AMI602_MAX_DELAY_NS;
+    int64_t latency = -1;
+
+    for (int i = 0; i < NUM_HANDLES; i++) {
+        if (!(mEnabled & (1 << i)))
+            continue;
+        if (mDelays[i] < period)
+            period = mDelays[i];
+        // Channel clients read the shared ring, not mRing.
+        if (i != ID_CHANNEL && (latency < 0 || mLatencies[i] < latency))
+            latency = mLatencies[i];
+    }
+    mPeriod = period;
+    mLatency = latency < 0 ? 0 : latency;
+}
+
+/*
+ * Publishes the current control-plane state to mConfig. Called with mLock
+ * held, after every change to it.
+ */
+void sensors_poll_context_t::publishConfig()
+{
+    Config config;
+
+    config.enabled = mEnabled;
+    config.generation = ++mGeneration;
+    config.period = mPeriod;
+    config.latency = mLatency;
+    memcpy(config.delays, mDelays, sizeof(config.delays));
+    mConfig.write(config);
+}
+
+/*
+ * Wakes the sampler and waits, with mLock released, until it has applied
+ * the configuration published last. Returns what applying it returned.
+ * Called with mLock held.
+ */
+int sensors_poll_context_t::waitApplied()
+{
+    uint32_t gen = mGeneration;
+
+    wake(mCtlFd);
+    while (mSamplerRunning && (int32_t)(mAppliedGen - gen) < 0)
+        pthread_cond_wait(&mApplied, &mLock);
+    return mSamplerRunning ? mApplyErr : -ENODEV;
+}
+
+/*
+ * Brings the source and the sampling clock in line with config: the
+ * source is opened with the first enabled handle, sampling (re)started
+ * whenever the target period changes, and both are torn down with the
+ * last handle, so an idle HAL neither wakes up nor touches the I2C bus.
+ * Then reports the outcome to waitApplied(). Sampler thread only.
+ */
+void sensors_poll_context_t::applyConfig(const Config& config)
+{
+    int err = 0;
+
+    mSamplePeriod = config.period;
+    if (config.enabled && !mSourceOpen) {
+        err = mSource->open();
+        if (!err)
+            mSourceOpen = true;
+    }
+    if (config.enabled) {
+        if (!err && mArmedPeriod != targetPeriod())
+            err = startSampling();
+    } else if (mSourceOpen) {
+        stopSampling();
+        mSource->close();
+        mSourceOpen = false;
+    }
+    if (err)
+        LOGE("cannot start sampling (%s)", strerror(-err));
+
+    pthread_mutex_lock(&mLock);
+    mAppliedGen = config.generation;
+    mApplyErr = err;
+    pthread_cond_broadcast(&mApplied);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*
+ * The period to actually sample at: mSamplePeriod, unless the device is
+ * still and adaptive sampling may slow it down. Sampler thread only.
+ */
+int64_t sensors_poll_context_t::targetPeriod()
+{
+    if (mIdle && mIdlePeriod > mSamplePeriod)
+        return mIdlePeriod;
+    return mSamplePeriod;
+}
+
+/*
+ * Charges the time since the last change to the period sampled at until
+ * now, then switches to the new one. Sampler thread only.
+ */
+void sensors_poll_context_t::setArmedPeriod(int64_t period)
+{
+    int64_t now = getTimeNano();
+
+    if (mArmedPeriod)
+        mStats.addRateTime(mArmedPeriod, now - mArmedSince);
+    mArmedPeriod = period;
+    mArmedSince = now;
+}
+
+/*
+ * Arms the sampling timer as an absolute, periodic CLOCK_MONOTONIC timer.
+ * The kernel advances the deadline by exactly one period on each
+ * expiration, so ioctl time and scheduling latency never accumulate
+ * into drift. Sampler thread only.
+ */
+int sensors_poll_context_t::armTimer()
+{
+    struct itimerspec its;
+    int64_t period = targetPeriod();
+    int64_t first = getTimeNano() + period;
+
+    its.it_value.tv_sec = first / 1000000000;
+    its.it_value.tv_nsec = first % 1000000000;
+    its.it_interval.tv_sec = period / 1000000000;
+    its.it_interval.tv_nsec = period % 1000000000;
+
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        int err = -errno;
+        LOGE("timerfd_settime failed (%s)", strerror(-err));
+        return err;
+    }
+    setArmedPeriod(period);
+    return 0;
+}
+
+void sensors_poll_context_t::disarmTimer()
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(mTimerFd, 0, &its, NULL);
+    setArmedPeriod(0);
+}
+
+/*
+ * (Re)starts sampling at targetPeriod(). A streaming source is handed the period
+ * and clocks itself; otherwise the sampler's timer is armed. Sampler
+ * thread only.
+ */
+int sensors_poll_context_t::startSampling()
+{
+    int64_t period = targetPeriod();
+    int err = mSource->startFifo(period);
+
+    if (err == -ENOSYS) {
+        mStreaming = false;
+        return armTimer();
+    }
+    if (err)
+        return err;
+
+    setArmedPeriod(period);
+    mStreaming = true;
+    return 0;
+}
+
+void sensors_poll_context_t::stopSampling()
+{
+    if (mStreaming) {
+        mSource->startFifo(0);
+        mStreaming = false;
+        setArmedPeriod(0);
+    } else {
+        disarmTimer();
+    }
+    mMeasuring = false;
+    if (mRecorder)
+        mRecorder->flush();
+}
+
+void sensors_poll_context_t::wake(int fd)
+{
+    uint64_t one = 1;
+    write(fd, &one, sizeof(one));
+}
+
+/*
+ * Starts taking a sample at a timer deadline. In trigger mode this only
+ * kicks off the measurement and the sampler collects the result once the
+ * source signals completion; otherwise the position is read right away.
+ * Called on the sampler thread. Returns 1 if rec holds a
+ * finished sample, 0 if a measurement is in flight, or a negative errno.
+ */
+int sensors_poll_context_t::startSample(struct ami602_sample* rec)
+{
+    int64_t start;
+    int ret;
+
+    if (mMeasuring) {
+        LOGW("%s: measurement did not complete within one period",
+                __FUNCTION__);
+        mMeasuring = false;
+    }
+
+    ret = mSource->trigger();
+    if (ret == 0) {
+        mMeasuring = true;
+        mTriggerTime = getTimeNano();
+        return 0;
+    }
+    if (ret != -ENOSYS) {
+        mStats.errors++;
+        return ret;
+    }
+
+    start = getTimeNano();
+    ret = mSource->read(&rec->pos);
+    if (ret < 0) {
+        mStats.errors++;
+        return ret;
+    }
+    rec->timestamp = getTimeNano();
+    mStats.acquire.add(rec->timestamp - start);
+    return 1;
+}
+
+/*
+ * Queues finished samples for pollEvents(), which is signalled for every
+ * sample when nobody batches, and otherwise once the oldest unreported
+ * sample reaches the report latency or the ring is three-quarters full.
+ * Samples are recorded, when asked to, before anything can drop them,
+ * and go to channel clients; mRing is skipped while only channel clients
+ * are sampling.
+ */
+void sensors_poll_context_t::publish(const struct ami602_sample* recs,
+        int count, int64_t latency, bool toRing)
+{
+    int written;
+
+    if (mRecorder)
+        mRecorder->append(recs, count);
+    if (mAdaptive)
+        adapt(recs, count);
+    if (mChannel)
+        mChannel->publish(recs, count);
+    if (!toRing)
+        return;
+
+    written = mRing.write(recs, count);
+    mStats.samples += written;
+
+    if (written != count) {
+        mStats.drops += count - written;
+        LOGW("%s: ring full, %d sample(s) dropped", __FUNCTION__,
+                count - written);
+    }
+    if (mOldest < 0)
+        mOldest = recs[0].timestamp;
+
+    if (latency == 0 ||
+            recs[count - 1].timestamp - mOldest >= latency ||
+            mRing.size() >= mRing.capacity() * 3 / 4) {
+        wake(mPollFd.fd);
+        mOldest = -1;
+    }
+}
+
+void* sensors_poll_context_t::samplerThread(void* arg)
+{
+    ((sensors_poll_context_t*)arg)->samplerLoop();
+    return NULL;
+}
+
+/*
+ * Sampler thread. Blocks on the sampling timer, the control eventfd and,
+ * while the source streams or a triggered measurement is in flight, the
+ * source's data-ready fd. A streaming source is drained in bulk, with the
+ * capture times it reports, but only while the ring has room for a whole
+ * batch: otherwise the samples are left queued in the source and the
+ * sampler checks back shortly. Deadlines missed while a sample was being
+ * taken are dropped rather than replayed back-to-back.
+ */
+void sensors_poll_context_t::samplerLoop()
+{
+    struct ami602_sample recs[BATCH_READ];
+
+    while (!android_atomic_acquire_load(&mExit)) {
+        struct pollfd fds[3 + Ami602ChannelServer::MAX_POLL_FDS];
+        struct ami602_sample& rec = recs[0];
+        uint64_t expirations;
+        Config config;
+        int nfds = 2;
+        int src = -1;           // index of the source fd in fds, if polled
+        int chan = 0;           // index of the first channel fd
+        int timeout = -1;
+        int ret;
+
+        fds[0].fd = mTimerFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = mCtlFd;
+        fds[1].events = POLLIN;
+
+        mConfig.read(&config);
+        if (config.generation != mAppliedGen)
+            applyConfig(config);
+
+        if (mStreaming && mRing.capacity() - mRing.size() < BATCH_READ) {
+            timeout = 1;
+        } else if (mMeasuring || mStreaming) {
+            src = nfds++;
+            fds[src].fd = mSource->fd();
+            fds[src].events = POLLIN;
+        }
+
+        if (mChannel) {
+            chan = nfds;
+            nfds += mChannel->pollFds(&fds[chan]);
+        }
+        if (mStatsPath[0] && (timeout < 0 || timeout > STATS_PERIOD_MS))
+            timeout = STATS_PERIOD_MS;
+        ret = saveCalib(false);
+        if (ret >= 0 && (timeout < 0 || timeout > ret))
+            timeout = ret;
+
+        ret = poll(fds, nfds, timeout);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("%s: poll failed (%s)", __FUNCTION__, strerror(errno));
+            break;
+        }
+        if (mStatsPath[0])
+            dumpStats();
+
+        if (fds[1].revents & POLLIN)
+            read(mCtlFd, &expirations, sizeof(expirations));
+
+        if (mChannel && mChannel->handle(&fds[chan], nfds - chan))
+            updateChannel();
+
+        if (src >= 0 && (fds[src].revents & POLLIN)) {
+            int64_t start = getTimeNano();
+            if (mStreaming) {
+                ret = mSource->readFifo(recs, BATCH_READ);
+            } else if (mMeasuring) {
+                mStats.conversion.add(start - mTriggerTime);
+                rec.timestamp = start;
+                ret = mSource->read(&rec.pos) < 0 ? -EIO : 1;
+                mMeasuring = false;
+            } else {
+                ret = 0;
+            }
+            if (ret < 0)
+                mStats.errors++;
+            else if (ret > 0)
+                mStats.acquire.add(getTimeNano() - start);
+            if (ret > 0) {
+                mConfig.read(&config);
+                publish(recs, ret, config.latency,
+                        (config.enabled & SENSOR_MASK) != 0);
+            }
+        }
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+        // The timer may have been disarmed since poll() returned.
+        if (read(mTimerFd, &expirations, sizeof(expirations)) !=
+                sizeof(expirations))
+            continue;
+        if (expirations > 1) {
+            mStats.missed += expirations - 1;
+            LOGV("%s: missed %llu sample deadline(s)", __FUNCTION__,
+                    (unsigned long long)(expirations - 1));
+        }
+
+        ret = mSourceOpen ? startSample(&rec) : -ENODEV;
+        if (ret > 0) {
+            mConfig.read(&config);
+            publish(&rec, 1, config.latency,
+                    (config.enabled & SENSOR_MASK) != 0);
+        }
+    }
+
+    if (mSourceOpen) {
+        stopSampling();
+        mSource->close();
+        mSourceOpen = false;
+    }
+    pthread_mutex_lock(&mLock);
+    mSamplerRunning = false;
+    pthread_cond_broadcast(&mApplied);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*
+ * Samples for channel clients as if they were one more handle, at the
+ * fastest period any of them asked for. Called on the sampler thread,
+ * which applies the new configuration on its next pass.
+ */
+void sensors_poll_context_t::updateChannel()
+{
+    int64_t period = mChannel->period();
+
+    pthread_mutex_lock(&mLock);
+    if (period) {
+        mDelays[ID_CHANNEL] = period;
+        mEnabled |= 1 << ID_CHANNEL;
+    } else {
+        mEnabled &= ~(1 << ID_CHANNEL);
+    }
+    updatePeriod();
+    publishConfig();
+    pthread_mutex_unlock(&mLock);
+}
+
+/*
+ * Slows sampling down to mIdlePeriod while the accelerometer says the
+ * device is still, and rearms at the requested period from the sample
+ * that shows motion, so the next one is at most a requested period away.
+ * The decimators keep their configuration for the requested period: they
+ * decide by time, so while idle each handle simply gets every sample.
+ * Called on the sampler thread.
+ */
+void sensors_poll_context_t::adapt(const struct ami602_sample* recs,
+        int count)
+{
+    bool still = mIdle;
+    int err = 0;
+
+    for (int i = 0; i < count; i++) {
+        const int accel[3] = {
+            recs[i].pos.accel_x, recs[i].pos.accel_y, recs[i].pos.accel_z
+        };
+        still = mStill.update(accel, recs[i].timestamp);
+    }
+    if (still == mIdle)
+        return;
+
+    mIdle = still;
+    if (mSourceOpen && mArmedPeriod != targetPeriod())
+        err = startSampling();
+
+    LOGV("%s: device %s", __FUNCTION__, still ? "still" : "moving");
+    if (err)
+        LOGE("cannot change the sampling rate (%s)", strerror(-err));
+}
+
+/*
+ * Writes out calibration that pollEvents() learned, unless the last save
+ * was less than AMI602_CALIB_SAVE_MS ago and force is false, so a burst of
+ * updates costs one write. Called on the sampler thread, or once it has
+ * exited. Returns the ms until a held-back save is due, or -1 if none is.
+ */
+int sensors_poll_context_t::saveCalib(bool force)
+{
+    int32_t gen = android_atomic_acquire_load(&mCalibGen);
+    struct ami602_coeffs coeffs;
+    int64_t now, wait;
+
+    if (gen == mCalibSavedGen)
+        return -1;
+
+    now = getTimeNano();
+    wait = mCalibSaved + AMI602_CALIB_SAVE_MS * 1000000LL - now;
+    if (wait > 0 && !force)
+        return (int)(wait / 1000000) + 1;
+
+    mCalibOut.read(&coeffs);
+    mCalibSavedGen = gen;
+    mCalibSaved = now;
+    if (Calibrator::save(AMI602_CALIB_FILE, coeffs))
+        LOGW("cannot save calibration to %s", AMI602_CALIB_FILE);
+    return -1;
+}
+
+/*
+ * Points each enabled handle's decimators at the current sampling period
+ * and its requested output period. Handles whose rates did not change
+ * keep their filter state; newly enabled ones start afresh.
+ */
+void sensors_poll_context_t::configureDecimators(const Config& config)
+{
+    const uint32_t enabled = config.enabled & SENSOR_MASK;
+    const int64_t* delays = config.delays;
+    const int64_t period = config.period;
+
+    if (config.generation == mSeenGen)
+        return;
+    mSeenGen = config.generation;
+
+    // Fusion restarts from the next sample whenever it was idle.
+    if (!(mDecIn[ID_G] || mDecIn[ID_L] || mDecIn[ID_R]))
+        mFusion.reset();
+
+    for (int h = 0; h < MAX_NUM_SENSORS; h++) {
+        if (!(enabled & (1 << h))) {
+            mDecIn[h] = mDecOut[h] = 0;
+            continue;
+        }
+        if (mDecIn[h] == period && mDecOut[h] == delays[h])
+            continue;
+        if (!mDecIn[h])
+            mLastSent[h] = -1;      // newly enabled: deliver the first event
+        mDecIn[h] = period;
+        mDecOut[h] = delays[h];
+
+        switch (h) {
+        case ID_A:
+            mDecimators[DEC_A].configure(period, delays[h], mCutoff);
+            break;
+        case ID_M:
+            mDecimators[DEC_M].configure(period, delays[h], mCutoff);
+            break;
+        case ID_O:
+            mDecimators[DEC_OA].configure(period, delays[h], mCutoff);
+            mDecimators[DEC_OM].configure(period, delays[h], mCutoff);
+            break;
+        case ID_G:
+            mDecimators[DEC_G].configure(period, delays[h], mCutoff);
+            break;
+        case ID_L:
+            mDecimators[DEC_L].configure(period, delays[h], mCutoff);
+            break;
+        case ID_R:
+            mDecimators[DEC_R].configure(period, delays[h], 0);
+            break;
+        }
+    }
+}
+
+/*
+ * Reads AMI602_SUPPRESS_PROPERTY.<id> for every handle, as
+ * "<deadband>[,<max silence in ms>]". Handles without it deliver every
+ * event.
+ */
+#define BC10_SUPPRESS_NAME(id, name, type, maxRange, resolution, power) \
+        AMI602_SUPPRESS_PROPERTY "." #id,
+
+void sensors_poll_context_t::loadSuppression()
+{
+    static const char* const names[MAX_NUM_SENSORS] = {
+        BC10_SENSORS(BC10_SUPPRESS_NAME)
+    };
+    char value[PROPERTY_VALUE_MAX];
+
+    mSuppressMask = 0;
+    for (int h = 0; h < MAX_NUM_SENSORS; h++) {
+        const char* silence;
+
+        mLastSent[h] = -1;
+        if (property_get(names[h], value, NULL) <= 0)
+            continue;
+
+        mDeadband[h] = atof(value);
+        silence = strchr(value, ',');
+        mMaxSilence[h] = (silence ? atoll(silence + 1) :
+                AMI602_SUPPRESS_SILENCE_MS) * 1000000LL;
+        mSuppressMask |= 1 << h;
+        LOGI("%s: deadband %g, heartbeat every %lld ms", names[h],
+                mDeadband[h], (long long)(mMaxSilence[h] / 1000000));
+    }
+}
+
+/*
+ * Drops the first count queued events of suppressed handles that changed
+ * by less than their deadband on every axis since the last one delivered,
+ * unless that was more than the handle's maximum silence ago. Returns the
+ * number of events kept.
+ */
+int sensors_poll_context_t::suppress(int count)
+{
+    int kept = 0;
+
+    for (int i = 0; i < count; i++) {
+        const sensors_event_t& ev = mEvents[i];
+        int h = ev.sensor;
+
+        if (mSuppressMask & (1 << h)) {
+            float* last = mLastValue[h];
+            float band = mDeadband[h];
+
+            if (mLastSent[h] >= 0 &&
+                    ev.timestamp - mLastSent[h] < mMaxSilence[h] &&
+                    fabsf(ev.data[0] - last[0]) < band &&
+                    fabsf(ev.data[1] - last[1]) < band &&
+                    fabsf(ev.data[2] - last[2]) < band &&
+                    (h != ID_R || fabsf(ev.data[3] - last[3]) < band)) {
+                mStats.suppressed[h]++;
+                continue;
+            }
+            mLastSent[h] = ev.timestamp;
+            memcpy(last, ev.data, sizeof(mLastValue[h]));
+        }
+        if (kept != i)
+            mEvents[kept] = ev;
+        kept++;
+    }
+    return kept;
+}
+
+/*
+ * Per-record work of each handle. Whatever a handle emits is queued at
+ * mEventEnd; orientation only queues the event and its filtered inputs,
+ * and is filled in once per batch by process().
+ */
+void sensors_poll_context_t::pushVec(int h, Decimator& dec,
+        const float in[3], int64_t t)
+{
+    float out[3];
+
+    if (dec.push(in, t, out)) {
+        sensors_event_t* ev = mEventEnd++;
+        *ev = event[h];
+        ev->data[0] = out[0];
+        ev->data[1] = out[1];
+        ev->data[2] = out[2];
+        ev->timestamp = t;
+    }
+}
+
+template<>
+inline void sensors_poll_context_t::emit<ID_A>(const struct ami602_vec& v,
+        int64_t t)
+{
+    pushVec(ID_A, mDecimators[DEC_A], v.accel, t);
+}
+
+template<>
+inline void sensors_poll_context_t::emit<ID_M>(const struct ami602_vec& v,
+        int64_t t)
+{
+    pushVec(ID_M, mDecimators[DEC_M], v.mag, t);
+}
+
+template<>
+inline void sensors_poll_context_t::emit<ID_O>(const struct ami602_vec& v,
+        int64_t t)
+{
+    struct ami602_vec& in = mOrientIn[mNumOrient];
+    bool due = mDecimators[DEC_OA].push(v.accel, t, in.accel);
+
+    mDecimators[DEC_OM].push(v.mag, t, in.mag);
+    if (due) {
+        *mEventEnd = event[ID_O];
+        mEventEnd->timestamp = t;
+        mOrientSlot[mNumOrient++] = mEventEnd - mEvents;
+        mEventEnd++;
+    }
+}
+
+template<>
+inline void sensors_poll_context_t::emit<ID_G>(const struct ami602_vec& v,
+        int64_t t)
+{
+    float in[3];
+
+    mFusion.gravity(in);
+    pushVec(ID_G, mDecimators[DEC_G], in, t);
+}
+
+template<>
+inline void sensors_poll_context_t::emit<ID_L>(const struct ami602_vec& v,
+        int64_t t)
+{
+    float in[3];
+
+    mFusion.linear(v.accel, in);
+    pushVec(ID_L, mDecimators[DEC_L], in, t);
+}
+
+template<>
+inline void sensors_poll_context_t::emit<ID_R>(const struct ami602_vec& v,
+        int64_t t)
+{
+    if (mDecimators[DEC_R].tick(t)) {
+        *mEventEnd = event[ID_R];
+        mFusion.rotation(mEventEnd->data);
+        mEventEnd->timestamp = t;
+        mEventEnd++;
+    }
+}
+
+/*
+ * Runs count converted records through the handles in Mask and queues the
+ * resulting events in mEvents. Orientation is computed once for all the
+ * records where it is due, in one vectorized call, and Fusion only runs
+ * while one of its handles is enabled. Returns the number of events
+ * queued.
+ */
+#define BC10_EMIT(id, name, type, maxRange, resolution, power) \
+        if (Mask & (1 << ID_##id)) \
+            emit<ID_##id>(v, t);
+
+template<uint32_t Mask>
+int sensors_poll_context_t::process(int count)
+{
+    mEventEnd = mEvents;
+    mNumOrient = 0;
+
+    for (int i = 0; i < count; i++) {
+        const struct ami602_vec& v = mVecs[i];
+        int64_t t = mBatch[i].timestamp;
+
+        if (Mask & ID_FUSED_MASK)
+            mFusion.update(v, t);
+        BC10_SENSORS(BC10_EMIT)
+    }
+
+    if ((Mask & (1 << ID_O)) && mNumOrient) {
+        ami602_orient(mOrientIn, mNumOrient, mOrient);
+        for (int k = 0; k < mNumOrient; k++) {
+            sensors_event_t* o = &mEvents[mOrientSlot[k]];
+            o->orientation.azimuth = mOrient[k].azimuth;
+            o->orientation.pitch   = mOrient[k].pitch;
+            o->orientation.roll    = mOrient[k].roll;
+        }
+    }
+
+    return mEventEnd - mEvents;
+}
+
+sensors_poll_context_t::ProcessFn
+        sensors_poll_context_t::sProcess[1 << MAX_NUM_SENSORS];
+
+template<uint32_t Mask>
+void sensors_poll_context_t::fillProcess(ProcessFn* table)
+{
+    table[Mask] = &sensors_poll_context_t::process<Mask>;
+    fillProcess<Mask - 1>(table);
+}
+
+template<>
+void sensors_poll_context_t::fillProcess<0>(ProcessFn* table)
+{
+    table[0] = &sensors_poll_context_t::process<0>;
+}
+
+void sensors_poll_context_t::initProcess()
+{
+    fillProcess<(1 << MAX_NUM_SENSORS) - 1>(sProcess);
+}
+
+/*
+ * Counts the callers in flight, so close() can wait for them to leave.
+ * Both sides store before they load, with full barriers in between, so
+ * either the poller sees mClosing or close() sees it in mPollers; only
+ * the last poller out of a closing HAL takes mLock, to signal it.
+ */
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
-    int cnt = count;
+    int ret = -ENODEV;
+
+    android_atomic_inc(&mPollers);
+    if (!android_atomic_acquire_load(&mClosing))
+        ret = readEvents(data, count);
+
+    if (android_atomic_dec(&mPollers) == 1 &&
+            android_atomic_acquire_load(&mClosing)) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_signal(&mPollersDone);
+        pthread_mutex_unlock(&mLock);
+    }
+    return ret;
+}
+
+/*
+ * Blocks until the sampler signals a batch, then drains and processes
+ * ring records until data is full or the ring is empty, and returns
+ * whatever events it has. Events that do not fit are delivered on the
+ * next call. mPollFd is also signalled by flush() and by every
+ * configuration change, which are then picked up at once, and by close(),
+ * which makes this return -ENODEV.
+ */
+int sensors_poll_context_t::readEvents(sensors_event_t* data, int count)
+{
+    sensors_event_t* const first = data;
     int num = 0;
-    int ret;
 
-    while (cnt) {
-        if (stat <= 0) {
-            usleep(50000);
-            ret = ioctl(mPollFd.fd, AMI602_IOCPOSITION, &pos);
-            if (ret < 0) {
-                LOGE("%s: ret=%d", __FUNCTION__, ret);
-                return -1;
+    for (;;) {
+        uint32_t enabled, flushed;
+        Config config;
+
+        if (android_atomic_acquire_load(&mClosing)) {
+            // Pass the wakeup on to any other caller still blocked.
+            wake(mPollFd.fd);
+            return -ENODEV;
+        }
+        mConfig.read(&config);
+        enabled = config.enabled & SENSOR_MASK;
+        flushed = android_atomic_acquire_load(&mFlushPending);
+        configureDecimators(config);
+
+        while (num < count) {
+            int64_t start;
+            int n;
+
+            if (mEventPos == mEventLen) {
+                n = mRing.read(mBatch, BATCH_READ);
+                if (n == 0)
+                    break;
+                if (!enabled)
+                    continue;
+                start = getTimeNano();
+                ami602_convert(mBatch, n, &mCalib.coeffs(), mVecs);
+                mStats.convert.add(getTimeNano() - start);
+                if (mCalibLearn && mCalib.update(mVecs, n)) {
+                    mCalibOut.write(mCalib.coeffs());
+                    android_atomic_inc(&mCalibGen);
+                }
+                mEventLen = (this->*sProcess[enabled])(n);
+                if (enabled & mSuppressMask)
+                    mEventLen = suppress(mEventLen);
+                mEventPos = 0;
+                continue;
             }
-            stat = MAX_NUM_SENSORS;
-            //      ID_ACCELERATION
-
-            // Original formula
-            // sensors[0].acceleration.x = (((float)(pos.accel_x - 2048) * GRAVITY_EARTH * -1.0) / 800.0f );
-            // sensors[0].acceleration.y = (((float)(pos.accel_y - 2048) * GRAVITY_EARTH ) / 800.0f );
-            // sensors[0].acceleration.z = (((float)(pos.accel_z - 2048) * GRAVITY_EARTH * -1.0) / 800.0f );
-            event[0].acceleration.x = 25.1f - (float)pos.accel_x * 0.01225f;
-            event[0].acceleration.y = (float)pos.accel_y * 0.01225f - 25.1f;
-            event[0].acceleration.z = 25.1f - (float)pos.accel_z * 0.01225f;
-
-            //  ID_MAGNETIC_FIELD
-            //  AMI602 value: 1gauss = 600, 1uT = 6
-            event[1].magnetic.x = (((float)(pos.mag_x - 2048) / 6.0f));
-            event[1].magnetic.y = (((float)(pos.mag_y - 2048) / 6.0f));
-            event[1].magnetic.z = (((float)(pos.mag_z - 2048) / 6.0f));
-
-            //  ID_ORIENTATION
-            event[2].orientation.azimuth = atan2( (event[1].magnetic.y * -1),  event[1].magnetic.x) * one_rad + 180;
-            event[2].orientation.pitch   = atan2( (event[0].acceleration.y * -1),  event[0].acceleration.z ) * one_rad;
-            event[2].orientation.roll    = atan2( (event[0].acceleration.x * -1),  event[0].acceleration.z ) * one_rad;
-        }
-
-        if (stat > 0) {
-            switch (stat) {
-            case 1:
-                *data = event[0];
-                break;
-            case 2:
-                *data = event[1];
-                break;
-            case 3:
-                *data = event[2];
-                break;
+
+            n = mEventLen - mEventPos;
+            if (n > count - num)
+                n = count - num;
+            memcpy(data, &mEvents[mEventPos], n * sizeof(*data));
+            mEventPos += n;
+            data += n;
+            num += n;
+        }
+
+        // Only completions that fit are consumed; the rest go out on the
+        // next call.
+        if (flushed && num < count && mEventPos == mEventLen &&
+                mRing.size() == 0) {
+            uint32_t emitted = flushed;
+#ifdef SENSORS_DEVICE_API_VERSION_1_1
+            emitted = 0;
+            for (int i = 0; i < MAX_NUM_SENSORS && num < count; i++) {
+                if (!(flushed & (1 << i)))
+                    continue;
+                memset(data, 0, sizeof(*data));
+                data->version = META_DATA_VERSION;
+                data->type = SENSOR_TYPE_META_DATA;
+                data->meta_data.what = META_DATA_FLUSH_COMPLETE;
+                data->meta_data.sensor = i;
+                data++;
+                num++;
+                emitted |= 1 << i;
             }
-            data->timestamp = getTimeNano();
-            data++;
-            num++;
-            stat--;
-            cnt--;
+#endif
+            android_atomic_and(~emitted, &mFlushPending);
         }
+
+        if (num > 0) {
+            account(first, num);
+            return num;
+        }
+
+        uint64_t signalled;
+        if (poll(&mPollFd, 1, -1) < 0 && errno != EINTR) {
+            int err = -errno;
+            LOGE("%s: poll failed (%s)", __FUNCTION__, strerror(-err));
+            return err;
+        }
+        if (mPollFd.revents & POLLIN)
+            read(mPollFd.fd, &signalled, sizeof(signalled));
     }
-    return num;
 }
 
 int64_t sensors_poll_context_t::getTimeNano()
@@ -171,6 +1378,49 @@ int64_t sensors_poll_context_t::getTimeNano()
     return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
+/*
+ * Records how long each delivered event waited between capture and
+ * delivery, per handle.
+ */
+void sensors_poll_context_t::account(const sensors_event_t* data, int count)
+{
+    int64_t now = getTimeNano();
+
+    for (int i = 0; i < count; i++) {
+        int h = data[i].sensor;
+#ifdef SENSORS_DEVICE_API_VERSION_1_1
+        if (data[i].type == SENSOR_TYPE_META_DATA)
+            continue;
+#endif
+        mStats.queue[h].add(now - data[i].timestamp);
+        mStats.events[h]++;
+    }
+    mStats.returns++;
+}
+
+/*
+ * Rewrites the stats file if a period has passed since the last time.
+ * Called on the sampler thread.
+ */
+void sensors_poll_context_t::dumpStats()
+{
+    int64_t now = getTimeNano();
+    int err;
+
+    if (now - mStatsDumped < STATS_PERIOD_MS * 1000000LL)
+        return;
+    mStatsDumped = now;
+
+    // Charge the time at the current rate so far.
+    setArmedPeriod(mArmedPeriod);
+
+    err = mStats.dump(mStatsPath);
+    if (err) {
+        LOGE("cannot write stats to %s (%s)", mStatsPath, strerror(-err));
+        mStatsPath[0] = 0;
+    }
+}
+
 /*****************************************************************************/
 
 static int poll__close(struct hw_device_t *dev)
@@ -200,6 +1450,19 @@ static int poll__poll(struct sensors_poll_device_t *dev,
     return ctx->pollEvents(data, count);
 }
 
+#ifdef SENSORS_DEVICE_API_VERSION_1_1
+static int poll__batch(struct sensors_poll_device_1 *dev,
+        int handle, int flags, int64_t period_ns, int64_t timeout) {
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->batch(handle, flags, period_ns, timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_1 *dev, int handle) {
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->flush(handle);
+}
+#endif
+
 /*****************************************************************************/
 
 int init_poll_bc10(const struct hw_module_t* module, const char* name,
@@ -208,10 +1471,16 @@ int init_poll_bc10(const struct hw_module_t* module, const char* name,
     int status = -EINVAL;
 
     sensors_poll_context_t *dev = new sensors_poll_context_t();
-    memset(&dev->device, 0, sizeof(sensors_poll_device_t));
+    memset(&dev->device, 0, sizeof(dev->device));
 
     dev->device.common.tag = HARDWARE_DEVICE_TAG;
+#ifdef SENSORS_DEVICE_API_VERSION_1_1
+    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_1;
+    dev->device.batch           = poll__batch;
+    dev->device.flush           = poll__flush;
+#else
     dev->device.common.version  = 0;
+#endif
     dev->device.common.module   = const_cast<hw_module_t*>(module);
     dev->device.common.close    = poll__close;
     dev->device.activate        = poll__activate;
@@ -35,12 +35,70 @@
 #include <hardware/sensors.h>
 #include "ami602.h"
 
-#define MAX_NUM_SENSORS 3
 #define AMI602_DEV "/dev/ami602"
 
-#define ID_A  (0)
-#define ID_M  (1)
-#define ID_O  (2)
+// Sampling period limits. The fastest rate across all handles drives
+// the AMI602; SENSOR_DELAY_NORMAL is used until a client asks otherwise.
+#define AMI602_MIN_DELAY_US     10000                       // 100 Hz
+#define AMI602_MIN_DELAY_NS     (AMI602_MIN_DELAY_US * 1000LL)
+#define AMI602_MAX_DELAY_NS     1000000000LL                // 1 Hz
+#define AMI602_DEFAULT_DELAY_NS 200000000LL                 // 5 Hz
+
+// Samples buffered between the sampler thread and pollEvents(). At the
+// fastest rate this holds about ten seconds of batched data.
+#define AMI602_RING_SIZE        1024
+
+/*
+ * The sensors this HAL exposes, in handle order, one
+ *     S(id, name, type, maxRange, resolution, power)
+ * per sensor. The handles (ID_<id>), MAX_NUM_SENSORS, the sensor list and
+ * the event templates are all generated from this table; what a handle
+ * computes is its emit<ID_<id>>() in poll_bc10.cpp.
+ */
+#define BC10_SENSORS(S) \
+    S(A, "bc10 3-axis Accelerometer", SENSOR_TYPE_ACCELEROMETER, \
+            2048.0f, 1.0f, 1.0f) \
+    S(M, "bc10 3-axis Magnetic field sensor", SENSOR_TYPE_MAGNETIC_FIELD, \
+            2048.0f, 1.0f, 1.0f) \
+    S(O, "bc10 Orientation sensor", SENSOR_TYPE_ORIENTATION, \
+            360.0f, 1.0f, 1.0f) \
+    S(G, "bc10 Gravity sensor", SENSOR_TYPE_GRAVITY, \
+            GRAVITY_EARTH * 2.0f, 1.0f, 2.0f) \
+    S(L, "bc10 Linear Acceleration sensor", SENSOR_TYPE_LINEAR_ACCELERATION, \
+            GRAVITY_EARTH * 2.0f, 1.0f, 2.0f) \
+    S(R, "bc10 Rotation Vector sensor", SENSOR_TYPE_ROTATION_VECTOR, \
+            1.0f, 1.0f, 2.0f)
+
+#define BC10_SENSOR_ID(id, name, type, maxRange, resolution, power) ID_##id,
+
+enum {
+    BC10_SENSORS(BC10_SENSOR_ID)
+    MAX_NUM_SENSORS
+};
+
+/*
+ * On-change delivery: setting AMI602_SUPPRESS_PROPERTY.<id> (e.g.
+ * "sensors.bc10.suppress.A") to "<deadband>[,<max silence in ms>]" drops
+ * that handle's events that moved less than the deadband, in its own
+ * units, on every axis since the last one delivered. One is still sent at
+ * least every max silence, AMI602_SUPPRESS_SILENCE_MS by default.
+ */
+#define AMI602_SUPPRESS_PROPERTY    "sensors.bc10.suppress"
+#define AMI602_SUPPRESS_SILENCE_MS  1000
+
+/*
+ * Motion-adaptive sampling: setting AMI602_ADAPTIVE_PROPERTY to
+ * "<threshold>[,<idle period in ms>]" lets the AMI602 slow down to the
+ * idle period once the accelerometer variance has stayed within the
+ * threshold, in raw counts^2, for AMI602_ADAPTIVE_HOLD_MS. The first
+ * sample that shows motion puts it back at the requested rate.
+ */
+#define AMI602_ADAPTIVE_PROPERTY    "sensors.bc10.adaptive"
+#define AMI602_ADAPTIVE_IDLE_MS     200
+#define AMI602_ADAPTIVE_HOLD_MS     1000
+
+// Handles derived in the HAL by Fusion; it only runs while one is enabled.
+#define ID_FUSED_MASK   ((1 << ID_G) | (1 << ID_L) | (1 << ID_R))
 
 __BEGIN_DECLS
 
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "record_bc10.h"
+
+/*****************************************************************************/
+
+Ami602Recorder::Ami602Recorder()
+    : mFile(NULL), mBuffer(NULL)
+{
+}
+
+Ami602Recorder::~Ami602Recorder()
+{
+    if (mFile)
+        fclose(mFile);
+    free(mBuffer);
+}
+
+Ami602Recorder* Ami602Recorder::create()
+{
+    char path[PROPERTY_VALUE_MAX];
+    Ami602Recorder* recorder;
+
+    if (property_get(AMI602_RECORD_PROPERTY, path, NULL) <= 0)
+        return NULL;
+
+    recorder = new Ami602Recorder();
+    if (recorder->open(path)) {
+        delete recorder;
+        return NULL;
+    }
+    LOGI("recording raw samples to %s", path);
+    return recorder;
+}
+
+int Ami602Recorder::open(const char* path)
+{
+    struct ami602_rec_header hdr;
+
+    mFile = fopen(path, "w");
+    if (!mFile) {
+        int err = -errno;
+        LOGE("cannot create recording %s (%s)", path, strerror(-err));
+        return err;
+    }
+    mBuffer = (char*)malloc(BUFFER_SIZE);
+    if (mBuffer)
+        setvbuf(mFile, mBuffer, _IOFBF, BUFFER_SIZE);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = AMI602_REC_MAGIC;
+    hdr.version = AMI602_REC_VERSION;
+    hdr.record_size = sizeof(struct ami602_sample);
+    if (fwrite(&hdr, sizeof(hdr), 1, mFile) != 1) {
+        LOGE("cannot write recording %s (%s)", path, strerror(errno));
+        return -EIO;
+    }
+    return 0;
+}
+
+void Ami602Recorder::append(const struct ami602_sample* recs, int count)
+{
+    if (fwrite(recs, sizeof(*recs), count, mFile) != (size_t)count)
+        LOGW("recording truncated (%s)", strerror(errno));
+}
+
+void Ami602Recorder::flush()
+{
+    fflush(mFile);
+}
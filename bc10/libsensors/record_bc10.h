@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_RECORD_BC10_H
+#define ANDROID_SENSORS_RECORD_BC10_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ami602.h"
+
+/*****************************************************************************/
+
+/*
+ * Raw sample recordings.
+ *
+ * A recording is a struct ami602_rec_header followed by struct
+ * ami602_sample records in capture order, all in host byte order. Setting
+ * AMI602_RECORD_PROPERTY to a path makes the HAL record every sample it
+ * takes there; "replay:<path>" as the source plays one back.
+ */
+#define AMI602_RECORD_PROPERTY  "sensors.bc10.record"
+#define AMI602_REPLAY_PROPERTY  "sensors.bc10.replay"   // "realtime" or "fast"
+
+#define AMI602_REC_MAGIC        0x32303641              // "A602"
+#define AMI602_REC_VERSION      1
+
+struct ami602_rec_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;       // sizeof(struct ami602_sample)
+    uint32_t reserved[2];
+};
+
+/*
+ * Appends samples to a recording through a large stdio buffer, so the
+ * sampler thread only enters the kernel once every few thousand samples.
+ */
+class Ami602Recorder {
+public:
+    Ami602Recorder();
+    ~Ami602Recorder();
+
+    int open(const char* path);
+    void append(const struct ami602_sample* recs, int count);
+    void flush();
+
+    // Starts recording if AMI602_RECORD_PROPERTY is set, else returns NULL.
+    static Ami602Recorder* create();
+
+private:
+    enum { BUFFER_SIZE = 64 * 1024 };
+
+    FILE* mFile;
+    char* mBuffer;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_RECORD_BC10_H
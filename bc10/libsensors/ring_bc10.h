@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_RING_BC10_H
+#define ANDROID_SENSORS_RING_BC10_H
+
+#include <stdint.h>
+#include <cutils/atomic.h>
+
+/*****************************************************************************/
+
+/*
+ * Bounded single-producer/single-consumer queue.
+ *
+ * The producer only ever stores mTail and the consumer only ever stores
+ * mHead; each publishes its index with a release store after touching the
+ * slots, and reads the other side's index with an acquire load. Indices run
+ * freely, wrapping at 2^32, and are masked on access, so N must be a power
+ * of two.
+ */
+template <typename T, int N>
+class SpscRing {
+public:
+    SpscRing() : mHead(0), mTail(0) { }
+
+    // Number of items currently queued. Exact from either side's thread.
+    int size() const {
+        return (int)((uint32_t)android_atomic_acquire_load(&mTail) -
+                     (uint32_t)android_atomic_acquire_load(&mHead));
+    }
+
+    int capacity() const { return N; }
+
+    // Producer side. Queues up to count items, returns how many fit.
+    int write(const T* items, int count) {
+        uint32_t tail = (uint32_t)mTail;
+        int room = N - (int)(tail -
+                (uint32_t)android_atomic_acquire_load(&mHead));
+        if (count > room)
+            count = room;
+        for (int i = 0; i < count; i++)
+            mItems[(tail + i) & (N - 1)] = items[i];
+        android_atomic_release_store((int32_t)(tail + count), &mTail);
+        return count;
+    }
+
+    // Consumer side. Dequeues up to count items, returns how many were read.
+    int read(T* items, int count) {
+        uint32_t head = (uint32_t)mHead;
+        int avail = (int)((uint32_t)android_atomic_acquire_load(&mTail) -
+                head);
+        if (count > avail)
+            count = avail;
+        for (int i = 0; i < count; i++)
+            items[i] = mItems[(head + i) & (N - 1)];
+        android_atomic_release_store((int32_t)(head + count), &mHead);
+        return count;
+    }
+
+private:
+    volatile int32_t mHead;     // next slot to read, owned by the consumer
+    volatile int32_t mTail;     // next slot to write, owned by the producer
+    T mItems[N];
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_RING_BC10_H
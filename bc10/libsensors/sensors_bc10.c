@@ -39,19 +39,14 @@
  * The SENSORS Module
  */
 
+#define BC10_SENSOR_T(id, name, type, maxRange, resolution, power) \
+        { name, \
+                "BeatCraft, Inc.", \
+                1, SENSORS_HANDLE_BASE+ID_##id, \
+                type, maxRange, resolution, power, AMI602_MIN_DELAY_US, { } },
+
 static const struct sensor_t sSensorList[] = {
-        { "bc10 3-axis Accelerometer",
-                "BeatCraft, Inc.",
-                1, SENSORS_HANDLE_BASE+ID_A,
-                SENSOR_TYPE_ACCELEROMETER, 2048.0f, 1.0f, 1.0f, 0, { } },
-        { "bc10 3-axis Magnetic field sensor",
-                "BeatCraft, Inc.",
-                1, SENSORS_HANDLE_BASE+ID_M,
-                SENSOR_TYPE_MAGNETIC_FIELD, 2048.0f, 1.0f, 1.0f, 0, { } },
-        { "bc10 Orientation sensor",
-                "BeatCraft, Inc.",
-                1, SENSORS_HANDLE_BASE+ID_O,
-                SENSOR_TYPE_ORIENTATION, 360.0f, 1.0f, 1.0f, 0, { } },
+        BC10_SENSORS(BC10_SENSOR_T)
 };
 
 static int open_sensors(const struct hw_module_t* module, const char* name,
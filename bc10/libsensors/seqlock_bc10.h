@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_SENSORS_SEQLOCK_BC10_H
+#define ANDROID_SENSORS_SEQLOCK_BC10_H
+
+#include <stdint.h>
+#include <cutils/atomic.h>
+
+/*****************************************************************************/
+
+/*
+ * A value published by one writer at a time and read by any number of
+ * threads without a lock.
+ *
+ * The writer makes mSeq odd before it touches the value and even again
+ * afterwards. A reader copies the value between two loads of mSeq and
+ * keeps the copy only if both saw the same even count, so it never acts
+ * on a half-written value and never makes the writer wait. Writers must
+ * be serialized by the caller. T must be plain data.
+ */
+template <typename T>
+class Seqlock {
+public:
+    Seqlock() : mSeq(0) { }
+
+    void write(const T& value) {
+        int32_t seq = mSeq;
+        android_atomic_acquire_store(seq + 1, &mSeq);
+        mValue = value;
+        android_atomic_release_store(seq + 2, &mSeq);
+    }
+
+    void read(T* value) const {
+        int32_t seq;
+        do {
+            seq = android_atomic_acquire_load(&mSeq);
+            *value = mValue;
+        } while ((seq & 1) || seq != android_atomic_release_load(&mSeq));
+    }
+
+private:
+    volatile int32_t mSeq;
+    T mValue;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_SEQLOCK_BC10_H
@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "poll_bc10.h"
+#include "source_bc10.h"
+#include "record_bc10.h"
+
+/*****************************************************************************/
+
+Ami602Source* Ami602Source::create()
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(AMI602_SOURCE_PROPERTY, value, "dev");
+    if (!strncmp(value, "replay:", 7)) {
+        LOGI("replaying AMI602 samples from %s", value + 7);
+        return new Ami602Replay(value + 7);
+    }
+    if (!strcmp(value, "stub") || !strcmp(value, "stub-trigger")) {
+        LOGI("using the userspace AMI602 stand-in (%s)", value);
+        return new Ami602Stub(!strcmp(value, "stub"));
+    }
+    return new Ami602Device();
+}
+
+/*****************************************************************************/
+
+Ami602Device::Ami602Device()
+    : mFd(-1), mCanTrigger(true), mCanStream(true)
+{
+}
+
+Ami602Device::~Ami602Device()
+{
+    close();
+}
+
+int Ami602Device::open()
+{
+    mFd = ::open(AMI602_DEV, O_RDWR);
+    if (mFd < 0) {
+        int err = -errno;
+        LOGE("cannot open %s (%s)", AMI602_DEV, strerror(-err));
+        return err;
+    }
+    return 0;
+}
+
+void Ami602Device::close()
+{
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+int Ami602Device::trigger()
+{
+    if (!mCanTrigger)
+        return -ENOSYS;
+
+    if (ioctl(mFd, AMI602_IOCTRIGGER) < 0) {
+        if (errno == ENOTTY || errno == EINVAL) {
+            LOGI("%s does not support triggered measurements", AMI602_DEV);
+            mCanTrigger = false;
+            return -ENOSYS;
+        }
+        return -errno;
+    }
+    return 0;
+}
+
+int Ami602Device::read(struct ami602_position* pos)
+{
+    int ret;
+
+    ret = ioctl(mFd, AMI602_IOCPOSITION, pos);
+    if (ret < 0) {
+        int err = -errno;
+        LOGE("%s: ret=%d (%s)", __FUNCTION__, ret, strerror(-err));
+        return err;
+    }
+    return 0;
+}
+
+int Ami602Device::startFifo(int64_t period)
+{
+    long long arg = period;
+
+    if (!mCanStream)
+        return -ENOSYS;
+
+    if (ioctl(mFd, AMI602_IOCSFIFO, &arg) < 0) {
+        if (errno == ENOTTY || errno == EINVAL) {
+            LOGI("%s does not support streaming", AMI602_DEV);
+            mCanStream = false;
+            return -ENOSYS;
+        }
+        return -errno;
+    }
+    return 0;
+}
+
+int Ami602Device::readFifo(struct ami602_sample* recs, int count)
+{
+    ssize_t n;
+
+    do {
+        n = ::read(mFd, recs, count * sizeof(*recs));
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        int err = -errno;
+        if (err == -EAGAIN)
+            return 0;
+        LOGE("%s: read failed (%s)", __FUNCTION__, strerror(-err));
+        return err;
+    }
+    return n / sizeof(*recs);
+}
+
+/*****************************************************************************/
+
+Ami602Stub::Ami602Stub(bool stream)
+    : mTimerFd(-1), mStream(stream), mPeriod(0), mNext(0), mSeed(1)
+{
+}
+
+Ami602Stub::~Ami602Stub()
+{
+    close();
+}
+
+int Ami602Stub::open()
+{
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (mTimerFd < 0)
+        return -errno;
+    return 0;
+}
+
+void Ami602Stub::close()
+{
+    if (mTimerFd >= 0) {
+        ::close(mTimerFd);
+        mTimerFd = -1;
+    }
+    mPeriod = 0;
+}
+
+int Ami602Stub::trigger()
+{
+    struct itimerspec its;
+
+    if (mStream)
+        return -ENOSYS;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = CONVERSION_NS;
+    if (timerfd_settime(mTimerFd, 0, &its, NULL) < 0)
+        return -errno;
+    return 0;
+}
+
+int Ami602Stub::read(struct ami602_position* pos)
+{
+    struct timespec ts;
+    uint64_t expirations;
+
+    // Acknowledge a completed trigger, if any.
+    ::read(mTimerFd, &expirations, sizeof(expirations));
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    synthesize((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec, pos);
+    return 0;
+}
+
+int Ami602Stub::startFifo(int64_t period)
+{
+    struct itimerspec its;
+    struct timespec now;
+
+    if (!mStream)
+        return -ENOSYS;
+
+    memset(&its, 0, sizeof(its));
+    if (period) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        mNext = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec + period;
+        its.it_value.tv_sec = mNext / 1000000000;
+        its.it_value.tv_nsec = mNext % 1000000000;
+        its.it_interval.tv_sec = period / 1000000000;
+        its.it_interval.tv_nsec = period % 1000000000;
+    }
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        return -errno;
+    mPeriod = period;
+    return 0;
+}
+
+/*
+ * Each timer expiration is one sample captured exactly on its deadline.
+ * Samples that do not fit are dropped, as a full driver FIFO would.
+ */
+int Ami602Stub::readFifo(struct ami602_sample* recs, int count)
+{
+    uint64_t expirations;
+    int n;
+
+    if (!mPeriod ||
+            ::read(mTimerFd, &expirations, sizeof(expirations)) !=
+            sizeof(expirations))
+        return 0;
+
+    n = expirations < (uint64_t)count ? (int)expirations : count;
+    mNext += (int64_t)(expirations - n) * mPeriod;
+    for (int i = 0; i < n; i++) {
+        recs[i].timestamp = mNext;
+        synthesize(mNext, &recs[i].pos);
+        mNext += mPeriod;
+    }
+    return n;
+}
+
+void Ami602Stub::synthesize(int64_t t, struct ami602_position* pos)
+{
+    double phase = 2 * M_PI * 0.1 * (t * 1e-9);
+
+    // Inverse of the conversions in pollEvents(): 0, 0, +1g and
+    // (30 cos, 30 sin, -40) uT.
+    pos->accel_x = 2049 + (rand_r(&mSeed) % 5) - 2;
+    pos->accel_y = 2049 + (rand_r(&mSeed) % 5) - 2;
+    pos->accel_z = 1248 + (rand_r(&mSeed) % 5) - 2;
+    pos->mag_x = 2048 + (int)(180 * cos(phase)) + (rand_r(&mSeed) % 3) - 1;
+    pos->mag_y = 2048 + (int)(180 * sin(phase)) + (rand_r(&mSeed) % 3) - 1;
+    pos->mag_z = 2048 - 240 + (rand_r(&mSeed) % 3) - 1;
+}
+
+/*****************************************************************************/
+
+static int64_t monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Ami602Replay::Ami602Replay(const char* path)
+    : mFast(false), mTimerFd(-1), mMap(MAP_FAILED), mMapSize(0),
+      mRecs(NULL), mCount(0), mPos(0), mShift(0), mRunning(false)
+{
+    char mode[PROPERTY_VALUE_MAX];
+
+    strncpy(mPath, path, sizeof(mPath) - 1);
+    mPath[sizeof(mPath) - 1] = 0;
+    property_get(AMI602_REPLAY_PROPERTY, mode, "realtime");
+    mFast = !strcmp(mode, "fast");
+}
+
+Ami602Replay::~Ami602Replay()
+{
+    close();
+}
+
+int Ami602Replay::map()
+{
+    const struct ami602_rec_header* hdr;
+    struct stat st;
+    int fd, err;
+
+    fd = ::open(mPath, O_RDONLY);
+    if (fd < 0) {
+        err = -errno;
+        LOGE("cannot open recording %s (%s)", mPath, strerror(-err));
+        return err;
+    }
+    if (fstat(fd, &st) < 0) {
+        err = -errno;
+        ::close(fd);
+        return err;
+    }
+    mMapSize = st.st_size;
+    mMap = mmap(NULL, mMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    err = -errno;
+    ::close(fd);
+    if (mMap == MAP_FAILED) {
+        LOGE("cannot map recording %s (%s)", mPath, strerror(-err));
+        return err;
+    }
+
+    hdr = (const struct ami602_rec_header*)mMap;
+    if (mMapSize < sizeof(*hdr) || hdr->magic != AMI602_REC_MAGIC ||
+            hdr->version != AMI602_REC_VERSION ||
+            hdr->record_size != sizeof(struct ami602_sample)) {
+        LOGE("%s is not an AMI602 recording", mPath);
+        return -EINVAL;
+    }
+    mRecs = (const struct ami602_sample*)(hdr + 1);
+    mCount = (mMapSize - sizeof(*hdr)) / sizeof(*mRecs);
+    if (!mCount) {
+        LOGE("recording %s is empty", mPath);
+        return -EINVAL;
+    }
+    madvise(mMap, mMapSize, MADV_SEQUENTIAL);
+    return 0;
+}
+
+int Ami602Replay::open()
+{
+    int err;
+
+    err = map();
+    if (err) {
+        close();
+        return err;
+    }
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (mTimerFd < 0) {
+        err = -errno;
+        close();
+        return err;
+    }
+    return 0;
+}
+
+void Ami602Replay::close()
+{
+    if (mTimerFd >= 0) {
+        ::close(mTimerFd);
+        mTimerFd = -1;
+    }
+    if (mMap != MAP_FAILED) {
+        munmap(mMap, mMapSize);
+        mMap = MAP_FAILED;
+    }
+    mRecs = NULL;
+    mCount = 0;
+    mRunning = false;
+}
+
+/*
+ * Fires the timer when the next sample is due, or straight away in fast
+ * mode.
+ */
+int Ami602Replay::armNext()
+{
+    struct itimerspec its;
+    int64_t t = mRecs[mPos].timestamp + mShift;
+    int flags = TFD_TIMER_ABSTIME;
+
+    memset(&its, 0, sizeof(its));
+    if (mFast) {
+        its.it_value.tv_nsec = 1;
+        flags = 0;
+    } else {
+        its.it_value.tv_sec = t / 1000000000;
+        its.it_value.tv_nsec = t % 1000000000;
+    }
+    if (timerfd_settime(mTimerFd, flags, &its, NULL) < 0)
+        return -errno;
+    return 0;
+}
+
+int Ami602Replay::startFifo(int64_t period)
+{
+    struct itimerspec its;
+
+    if (!period) {
+        memset(&its, 0, sizeof(its));
+        timerfd_settime(mTimerFd, 0, &its, NULL);
+        mRunning = false;
+        return 0;
+    }
+    if (!mRunning) {
+        mPos = 0;
+        mShift = monotonicNow() - mRecs[0].timestamp;
+        mRunning = true;
+    }
+    return armNext();
+}
+
+int Ami602Replay::readFifo(struct ami602_sample* recs, int count)
+{
+    uint64_t expirations;
+    int64_t now;
+    int n = 0;
+
+    if (!mRunning)
+        return 0;
+    ::read(mTimerFd, &expirations, sizeof(expirations));
+
+    now = monotonicNow();
+    while (n < count) {
+        const struct ami602_sample* rec = &mRecs[mPos];
+
+        if (!mFast && rec->timestamp + mShift > now)
+            break;
+        recs[n].timestamp = rec->timestamp + mShift;
+        recs[n].pos = rec->pos;
+        n++;
+
+        if (++mPos == mCount) {
+            // Start over one average sample spacing after the last sample.
+            int64_t span = mRecs[mCount - 1].timestamp - mRecs[0].timestamp;
+            mShift += span + (mCount > 1 ? span / (mCount - 1) :
+                    AMI602_MIN_DELAY_NS);
+            mPos = 0;
+        }
+    }
+    armNext();
+    return n;
+}
+
+int Ami602Replay::read(struct ami602_position* pos)
+{
+    if (!mCount)
+        return -ENODEV;
+    *pos = mRecs[mPos].pos;
+    if (++mPos == mCount)
+        mPos = 0;
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_SOURCE_BC10_H
+#define ANDROID_SENSORS_SOURCE_BC10_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <cutils/properties.h>
+#include "ami602.h"
+
+/*****************************************************************************/
+
+/*
+ * Selects the sample source: "dev" (default), "stub", "stub-trigger" or
+ * "replay:<path>" for a recording made through AMI602_RECORD_PROPERTY.
+ */
+#define AMI602_SOURCE_PROPERTY  "sensors.bc10.source"
+
+/*
+ * Where the sampler thread gets AMI602 positions from, in order of
+ * preference:
+ *
+ * Streaming sources sample on their own once startFifo() gives them a
+ * period, make fd() readable while samples are queued and hand them out,
+ * already timestamped, in bulk through readFifo().
+ *
+ * Sources that support triggered measurements start one in trigger() and
+ * make fd() readable once it has completed; the sampler polls for that
+ * instead of blocking in read().
+ *
+ * Otherwise startFifo() and trigger() return -ENOSYS and read() takes a
+ * measurement synchronously.
+ */
+class Ami602Source {
+public:
+    virtual ~Ami602Source() { }
+
+    virtual int open() = 0;
+    virtual void close() = 0;
+    virtual int fd() const = 0;
+    virtual int trigger() = 0;
+    virtual int read(struct ami602_position* pos) = 0;
+    virtual int startFifo(int64_t period) = 0;
+    virtual int readFifo(struct ami602_sample* recs, int count) = 0;
+
+    // Creates the source named by AMI602_SOURCE_PROPERTY.
+    static Ami602Source* create();
+};
+
+/*
+ * The AMI602 character device. Streaming and trigger modes are used when
+ * the driver implements AMI602_IOCSFIFO and AMI602_IOCTRIGGER.
+ */
+class Ami602Device : public Ami602Source {
+public:
+    Ami602Device();
+    virtual ~Ami602Device();
+
+    virtual int open();
+    virtual void close();
+    virtual int fd() const { return mFd; }
+    virtual int trigger();
+    virtual int read(struct ami602_position* pos);
+    virtual int startFifo(int64_t period);
+    virtual int readFifo(struct ami602_sample* recs, int count);
+
+private:
+    int mFd;
+    bool mCanTrigger;
+    bool mCanStream;
+};
+
+/*
+ * Userspace stand-in for the AMI602, for running the HAL without a bc10.
+ * It reports a device lying flat in a slowly rotating 30 uT horizontal
+ * field with a few counts of noise. In streaming mode a periodic timerfd
+ * stands in for the driver's sampling clock; otherwise triggered
+ * measurements complete after a fixed conversion time, signalled through
+ * a one-shot timerfd.
+ */
+class Ami602Stub : public Ami602Source {
+public:
+    Ami602Stub(bool stream);
+    virtual ~Ami602Stub();
+
+    virtual int open();
+    virtual void close();
+    virtual int fd() const { return mTimerFd; }
+    virtual int trigger();
+    virtual int read(struct ami602_position* pos);
+    virtual int startFifo(int64_t period);
+    virtual int readFifo(struct ami602_sample* recs, int count);
+
+private:
+    enum { CONVERSION_NS = 2000000 };
+
+    void synthesize(int64_t t, struct ami602_position* pos);
+
+    int mTimerFd;
+    bool mStream;
+    int64_t mPeriod;
+    int64_t mNext;          // capture time of the next streamed sample
+    unsigned int mSeed;
+};
+
+/*
+ * Plays back a recording, mapped read-only, as a streaming source. In
+ * "realtime" mode samples come out at their recorded spacing; in "fast"
+ * mode they come out as quickly as the sampler takes them, still stamped
+ * with the recorded spacing. Timestamps are shifted so the recording
+ * starts when streaming does, and playback loops at the end so long runs
+ * can be driven from a short capture. The requested period is ignored:
+ * the recording sets the rate.
+ */
+class Ami602Replay : public Ami602Source {
+public:
+    Ami602Replay(const char* path);
+    virtual ~Ami602Replay();
+
+    virtual int open();
+    virtual void close();
+    virtual int fd() const { return mTimerFd; }
+    virtual int trigger() { return -ENOSYS; }
+    virtual int read(struct ami602_position* pos);
+    virtual int startFifo(int64_t period);
+    virtual int readFifo(struct ami602_sample* recs, int count);
+
+private:
+    int map();
+    int armNext();
+
+    char mPath[PROPERTY_VALUE_MAX];
+    bool mFast;
+    int mTimerFd;
+    void* mMap;
+    size_t mMapSize;
+    const struct ami602_sample* mRecs;
+    int mCount;
+    int mPos;
+    int64_t mShift;         // added to recorded timestamps
+    bool mRunning;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_SOURCE_BC10_H
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include "stats_bc10.h"
+
+/*****************************************************************************/
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mMaxUs = 0;
+}
+
+int LatencyHistogram::bucketOf(int64_t ns)
+{
+    int shift;
+
+    if (ns < SUB_BUCKETS)
+        return ns < 0 ? 0 : (int)ns;
+
+    // The top bit selects the power of two, the SUB_BITS below it the
+    // bucket within it.
+    shift = 63 - __builtin_clzll((uint64_t)ns) - SUB_BITS;
+    if (shift >= MAX_SHIFT)
+        return NUM_BUCKETS - 1;
+    return (shift + 1) * SUB_BUCKETS + (int)((ns >> shift) & (SUB_BUCKETS - 1));
+}
+
+int64_t LatencyHistogram::bucketLimit(int bucket)
+{
+    int shift;
+    int64_t lower;
+
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    shift = bucket / SUB_BUCKETS - 1;
+    lower = (int64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lower + ((int64_t)1 << shift) - 1;
+}
+
+void LatencyHistogram::add(int64_t ns)
+{
+    mBuckets[bucketOf(ns)]++;
+    mCount++;
+    if (ns > max()) {
+        // Rounded up, so the maximum still bounds every value added.
+        int64_t us = (ns + 999) / 1000;
+        mMaxUs = us < 0xffffffffLL ? (uint32_t)us : 0xffffffffU;
+    }
+}
+
+int64_t LatencyHistogram::percentile(float p) const
+{
+    int64_t top = max();
+    uint32_t rank, seen = 0;
+
+    if (!mCount)
+        return 0;
+    rank = (uint32_t)(p * mCount);
+    if (rank >= mCount)
+        rank = mCount - 1;
+
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        seen += mBuckets[b];
+        if (seen > rank) {
+            int64_t limit = bucketLimit(b);
+            return limit < top ? limit : top;
+        }
+    }
+    return top;
+}
+
+/*****************************************************************************/
+
+Ami602Stats::Ami602Stats()
+    : samples(0), drops(0), missed(0), errors(0), returns(0)
+{
+    memset(events, 0, sizeof(events));
+    memset(suppressed, 0, sizeof(suppressed));
+    memset(ratePeriod, 0, sizeof(ratePeriod));
+    memset(rateTime, 0, sizeof(rateTime));
+}
+
+/*
+ * Periods past the first MAX_RATES distinct ones share the last entry.
+ */
+void Ami602Stats::addRateTime(int64_t period, int64_t ns)
+{
+    int i;
+
+    for (i = 0; i < MAX_RATES - 1; i++) {
+        if (ratePeriod[i] == period || !ratePeriod[i])
+            break;
+    }
+    ratePeriod[i] = period;
+    rateTime[i] += ns;
+}
+
+static void dumpHistogram(FILE* f, const char* name,
+        const LatencyHistogram& h)
+{
+    fprintf(f, "%-12s n=%u p50=%lld p99=%lld p999=%lld max=%lld us\n", name,
+            h.count(),
+            (long long)(h.percentile(0.5f) / 1000),
+            (long long)(h.percentile(0.99f) / 1000),
+            (long long)(h.percentile(0.999f) / 1000),
+            (long long)(h.max() / 1000));
+}
+
+int Ami602Stats::dump(const char* path) const
+{
+    char tmp[PATH_MAX];
+    char name[16];
+    FILE* f;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (!f)
+        return -errno;
+
+    fprintf(f, "samples %u drops %u missed %u errors %u returns %u\n",
+            samples, drops, missed, errors, returns);
+    dumpHistogram(f, "acquire", acquire);
+    dumpHistogram(f, "conversion", conversion);
+    dumpHistogram(f, "convert", convert);
+    for (int i = 0; i < MAX_NUM_SENSORS; i++) {
+        snprintf(name, sizeof(name), "queue[%d]", i);
+        dumpHistogram(f, name, queue[i]);
+        fprintf(f, "events[%d]    %u suppressed %u\n", i, events[i],
+                suppressed[i]);
+    }
+    for (int i = 0; i < MAX_RATES && ratePeriod[i]; i++) {
+        fprintf(f, "rate %lld us: %lld ms\n",
+                (long long)(ratePeriod[i] / 1000),
+                (long long)(rateTime[i] / 1000000));
+    }
+
+    if (fclose(f) || rename(tmp, path))
+        return -errno;
+    return 0;
+}
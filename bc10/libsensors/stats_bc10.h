@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_STATS_BC10_H
+#define ANDROID_SENSORS_STATS_BC10_H
+
+#include <stdint.h>
+#include "poll_bc10.h"
+
+/*****************************************************************************/
+
+// Path the HAL rewrites its Ami602Stats to about once a second.
+#define AMI602_STATS_PROPERTY   "sensors.bc10.stats"
+
+/*
+ * Histogram of nanosecond durations with log-linear buckets: each power
+ * of two is split into 2^SUB_BITS buckets, so any recorded value is known
+ * to within 12.5% at a fixed cost of one bucket lookup and no division.
+ * Values below 2^SUB_BITS ns get a bucket each; anything longer than
+ * about two hours lands in the last bucket.
+ *
+ * Every field is 32 bits wide, so another thread reading the histogram
+ * while it is being added to never sees half an update. That is why the
+ * maximum is kept in microseconds, rounded up.
+ */
+class LatencyHistogram {
+public:
+    enum {
+        SUB_BITS = 3,
+        SUB_BUCKETS = 1 << SUB_BITS,
+        MAX_SHIFT = 40,
+        NUM_BUCKETS = (MAX_SHIFT + 1) * SUB_BUCKETS,
+    };
+
+    LatencyHistogram();
+
+    void reset();
+    void add(int64_t ns);
+
+    uint32_t count() const { return mCount; }
+    int64_t max() const { return (int64_t)mMaxUs * 1000; }
+
+    // Upper bound of the bucket holding the p-th fraction of the values,
+    // or 0 if the histogram is empty.
+    int64_t percentile(float p) const;
+
+    static int bucketOf(int64_t ns);
+    static int64_t bucketLimit(int bucket);
+
+private:
+    uint32_t mBuckets[NUM_BUCKETS];
+    uint32_t mCount;
+    uint32_t mMaxUs;
+};
+
+/*
+ * Always-on pipeline statistics, cumulative since the HAL was opened.
+ * Each field has a single writer, the sampler thread or the poll thread
+ * as marked, and is updated with plain stores. dump() runs on the sampler
+ * thread, or once it has exited. The poll thread's fields are 32-bit
+ * counters and histograms, so it sees them at most a few updates stale
+ * but never torn.
+ */
+struct Ami602Stats {
+    // Sampler thread.
+    LatencyHistogram acquire;       // position ioctl or FIFO read
+    LatencyHistogram conversion;    // trigger to data-ready
+    uint32_t samples;               // published to the ring
+    uint32_t drops;                 // lost to a full ring
+    uint32_t missed;                // sample deadlines skipped
+    uint32_t errors;                // failed source calls
+
+    // Poll thread.
+    LatencyHistogram convert;       // ami602_convert() per batch
+    LatencyHistogram queue[MAX_NUM_SENSORS];    // capture to delivery
+    uint32_t events[MAX_NUM_SENSORS];
+    uint32_t suppressed[MAX_NUM_SENSORS];   // held back as unchanged
+    uint32_t returns;
+
+    // Sampler thread: time spent sampling at each period, for tuning
+    // adaptive sampling.
+    enum { MAX_RATES = 8 };
+    int64_t ratePeriod[MAX_RATES];  // 0 for an unused entry
+    int64_t rateTime[MAX_RATES];
+
+    Ami602Stats();
+
+    void addRateTime(int64_t period, int64_t ns);
+
+    // Writes a text report to path, replacing it atomically.
+    int dump(const char* path) const;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSORS_STATS_BC10_H
@@ -0,0 +1,93 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Checks and timings of the conversion and orientation kernels, built for
+# the host and for the target, where they use NEON:
+#     sensors_bc10_convert_test     exits non-zero on any mismatch or on an
+#                                   atan2 error over AMI602_ATAN2_MAX_ERROR_DEG
+#     sensors_bc10_convert_bench    times the kernels against the scalar code
+#                                   and libm
+#
+# sensors_bc10_record_test writes a recording and plays it back through the
+# replay source, in fast and realtime mode, and exits non-zero on any
+# difference.
+#
+# sensors_bc10_lockfree_stress runs Seqlock and SpscRing, as the HAL
+# instantiates them, under concurrent readers and writers, and exits non-zero
+# on any torn, lost or reordered value. It also passes when built with
+# -fsanitize=thread.
+#
+# sensors_bc10_poll_bench is a host build of the whole HAL on a stand-in
+# source, driving poll() over a range of sensors, rates and buffer sizes
+# and reporting delivery rate and latency percentiles.
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_convert_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := convert_test.cpp ../convert_bc10.cpp
+LOCAL_LDLIBS := -lm
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_convert_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := convert_test.cpp ../convert_bc10.cpp
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_convert_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := convert_bench.cpp ../convert_bc10.cpp
+LOCAL_CFLAGS := -O2
+LOCAL_LDLIBS := -lrt -lm
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_convert_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := convert_bench.cpp ../convert_bc10.cpp
+LOCAL_CFLAGS := -O2
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_record_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := record_test.cpp ../record_bc10.cpp ../source_bc10.cpp
+LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt -lm
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_lockfree_stress
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := lockfree_stress.cpp
+LOCAL_STATIC_LIBRARIES := libcutils
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bc10_poll_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := poll_bench.cpp \
+	../poll_bc10.cpp ../source_bc10.cpp ../convert_bc10.cpp ../filter_bc10.cpp \
+	../record_bc10.cpp ../stats_bc10.cpp ../fusion_bc10.cpp ../calib_bc10.cpp \
+	../channel_bc10.cpp \
+	../sensors_bc10.c
+LOCAL_CFLAGS := -O2 -DLOG_TAG=\"Sensors\"
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt -lm
+include $(BUILD_HOST_EXECUTABLE)
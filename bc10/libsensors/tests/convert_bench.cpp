@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Times the conversion kernels against their portable references, and
+ * the orientation kernels against libm, on synthetic samples. Built for
+ * the host and for the target, where ami602_convert() and ami602_orient()
+ * are the NEON kernels.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../convert_bc10.h"
+
+/*****************************************************************************/
+
+/*
+ * Deterministic pseudo-random numbers (xorshift32), the same on the host
+ * and the target.
+ */
+static uint32_t next(uint32_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+enum { NUM_SAMPLES = 1 << 16, BATCH = 64, ROUNDS = 50 };
+
+static struct ami602_sample sRecs[NUM_SAMPLES];
+static struct ami602_vec sVecs[NUM_SAMPLES];
+static struct ami602_orientation sOrient[NUM_SAMPLES];
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/*
+ * Converts the samples BATCH at a time, as pollEvents() does, and
+ * returns the time per sample in ns.
+ */
+static double timeConvert(void (*convert)(const struct ami602_sample*, int,
+        const struct ami602_coeffs*, struct ami602_vec*),
+        const struct ami602_coeffs* c)
+{
+    int64_t start = now();
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < NUM_SAMPLES; i += BATCH)
+            convert(sRecs + i, BATCH, c, sVecs + i);
+    }
+    return (double)(now() - start) / ((double)ROUNDS * NUM_SAMPLES);
+}
+
+typedef void (*orient_fn)(const struct ami602_vec*, int,
+        struct ami602_orientation*);
+
+// What the HAL did before ami602_orient(): three libm calls per sample.
+static void orientLibm(const struct ami602_vec* in, int count,
+        struct ami602_orientation* out)
+{
+    const float RAD_TO_DEG = 57.29577951f;
+
+    for (int i = 0; i < count; i++) {
+        out[i].azimuth =
+                atan2f(-in[i].mag[1], in[i].mag[0]) * RAD_TO_DEG + 180;
+        out[i].pitch = atan2f(-in[i].accel[1], in[i].accel[2]) * RAD_TO_DEG;
+        out[i].roll = atan2f(-in[i].accel[0], in[i].accel[2]) * RAD_TO_DEG;
+    }
+}
+
+// As timeConvert(), for the orientation of the converted samples.
+static double timeOrient(orient_fn orient)
+{
+    int64_t start = now();
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < NUM_SAMPLES; i += BATCH)
+            orient(sVecs + i, BATCH, sOrient + i);
+    }
+    return (double)(now() - start) / ((double)ROUNDS * NUM_SAMPLES);
+}
+
+int main()
+{
+    struct ami602_coeffs c;
+    uint32_t seed = 1;
+
+    ami602_default_coeffs(&c);
+    for (int i = 0; i < NUM_SAMPLES; i++) {
+        int* raw = &sRecs[i].pos.accel_x;
+        for (int k = 0; k < 6; k++)
+            raw[k] = 1848 + next(&seed) % 400;
+    }
+
+    // Warm up the caches, then take the better of three runs.
+    timeConvert(ami602_convert_scalar, &c);
+    double scalar = 1e9, kernel = 1e9;
+    for (int run = 0; run < 3; run++) {
+        double s = timeConvert(ami602_convert_scalar, &c);
+        double k = timeConvert(ami602_convert, &c);
+        if (s < scalar)
+            scalar = s;
+        if (k < kernel)
+            kernel = k;
+    }
+
+    ami602_convert(sRecs, NUM_SAMPLES, &c, sVecs);
+    double libm = 1e9, orientScalar = 1e9, orient = 1e9;
+    for (int run = 0; run < 3; run++) {
+        double l = timeOrient(orientLibm);
+        double s = timeOrient(ami602_orient_scalar);
+        double k = timeOrient(ami602_orient);
+        if (l < libm)
+            libm = l;
+        if (s < orientScalar)
+            orientScalar = s;
+        if (k < orient)
+            orient = k;
+    }
+
+    printf("ami602_convert_scalar: %.2f ns/sample\n", scalar);
+    printf("ami602_convert%s: %.2f ns/sample\n",
+#if defined(__ARM_NEON__)
+            " (NEON)",
+#else
+            " (scalar build)",
+#endif
+            kernel);
+    printf("libm atan2f: %.2f ns/sample\n", libm);
+    printf("ami602_orient_scalar: %.2f ns/sample\n", orientScalar);
+    printf("ami602_orient%s: %.2f ns/sample\n",
+#if defined(__ARM_NEON__)
+            " (NEON)",
+#else
+            " (scalar build)",
+#endif
+            orient);
+    return 0;
+}
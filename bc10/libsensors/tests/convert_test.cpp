@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Checks the conversion kernels against their portable references, and
+ * the atan2 kernel against AMI602_ATAN2_MAX_ERROR_DEG. Exits non-zero on
+ * any failure. Built for the host and for the target: on a NEON target
+ * ami602_convert() and ami602_orient() are the vector kernels, elsewhere
+ * they are the scalar code.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../convert_bc10.h"
+
+/*****************************************************************************/
+
+/*
+ * Deterministic pseudo-random numbers (xorshift32), the same on the host
+ * and the target.
+ */
+static uint32_t next(uint32_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static int sFailures;
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            if (sFailures++ < 10) {                     \
+                fprintf(stderr, __VA_ARGS__);           \
+                fprintf(stderr, "\n");                  \
+            }                                           \
+        }                                               \
+    } while (0)
+
+/*
+ * Raw values over the whole 12-bit range and beyond, against both the
+ * default and randomly calibrated coefficients. Batch sizes and the
+ * output alignment vary so no tail or offset path is skipped.
+ */
+static void testConvert()
+{
+    enum { MAX_BATCH = 67, ROUNDS = 20000 };
+    static struct ami602_sample recs[MAX_BATCH];
+    static struct ami602_vec ref[MAX_BATCH], vec[MAX_BATCH + 1];
+    struct ami602_coeffs c;
+    uint32_t seed = 1;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int count = next(&seed) % (MAX_BATCH + 1);
+        struct ami602_vec* out = vec + (round & 1);
+
+        ami602_default_coeffs(&c);
+        if (round & 2) {
+            for (int k = 0; k < 6; k++) {
+                c.bias[k] = next(&seed) % 4096;
+                c.scale[k] *= 0.5f + (next(&seed) >> 8) / 16777216.0f;
+                c.offset[k] += (next(&seed) >> 8) / 16777216.0f * 40 - 20;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            int* raw = &recs[i].pos.accel_x;
+
+            recs[i].timestamp = i;
+            for (int k = 0; k < 6; k++) {
+                switch (next(&seed) % 8) {
+                case 0: raw[k] = 0; break;
+                case 1: raw[k] = AMI602_SENSOR_DATA_MAX; break;
+                case 2: raw[k] = (int32_t)next(&seed) >> 1; break;
+                default: raw[k] = next(&seed) % 4096; break;
+                }
+            }
+        }
+
+        ami602_convert_scalar(recs, count, &c, ref);
+        ami602_convert(recs, count, &c, out);
+        CHECK(memcmp(ref, out, count * sizeof(*out)) == 0,
+                "ami602_convert differs from ami602_convert_scalar "
+                "(round %d, %d samples)", round, count);
+    }
+}
+
+// Error of an angle in degrees against libm, modulo 360.
+static double angleError(double deg, double y, double x, double offset)
+{
+    double e = fabs(deg - (atan2(y, x) * 180 / M_PI + offset));
+
+    return e > 180 ? fabs(e - 360) : e;
+}
+
+static double sMaxError;
+
+static void checkAtan2(float y, float x)
+{
+    double e;
+
+    if (x == 0.0f && y == 0.0f) {
+        CHECK(ami602_atan2_deg(y, x) == 0.0f, "atan2(%g, %g) != 0", y, x);
+        return;
+    }
+    e = angleError(ami602_atan2_deg(y, x), y, x, 0);
+    if (e > sMaxError)
+        sMaxError = e;
+    CHECK(e <= AMI602_ATAN2_MAX_ERROR_DEG,
+            "atan2(%.9g, %.9g) is off by %g degrees", y, x, e);
+}
+
+/*
+ * The scalar kernel over all finite inputs: a signed grid, a fine sweep
+ * of angles, every power of two from the smallest denormal to FLT_MAX
+ * against every other, and random finite bit patterns.
+ */
+static void testAtan2()
+{
+    const int GRID = 2000, ANGLES = 10000000, PATTERNS = 10000000;
+    uint32_t seed = 1;
+
+    for (int i = -GRID; i <= GRID; i++) {
+        for (int j = -GRID; j <= GRID; j++)
+            checkAtan2(i * 0.37f, j * 0.41f);
+    }
+    for (int k = 0; k < ANGLES; k++) {
+        double a = -M_PI + 2 * M_PI * k / ANGLES;
+        checkAtan2((float)(30 * sin(a)), (float)(30 * cos(a)));
+    }
+    for (int ey = -149; ey <= 127; ey++) {
+        for (int ex = -149; ex <= 127; ex++) {
+            float y = ldexpf(1.0f, ey), x = ldexpf(1.0f, ex);
+            checkAtan2(y, x);
+            checkAtan2(-y * 1.7f, x);
+            checkAtan2(y, -x * 0.6f);
+            checkAtan2(-y, -x);
+        }
+    }
+    checkAtan2(FLT_MAX, FLT_MAX);
+    checkAtan2(-FLT_MAX, -FLT_MAX);
+    for (int k = 0; k < PATTERNS; k++) {
+        uint32_t bits[2] = { next(&seed), next(&seed) };
+        float v[2];
+
+        memcpy(v, bits, sizeof(v));
+        if (isfinite(v[0]) && isfinite(v[1]))
+            checkAtan2(v[0], v[1]);
+    }
+    printf("ami602_atan2_deg: max error %.6f degrees\n", sMaxError);
+}
+
+// A random value of either sign with magnitude in [2^lo, 2^hi).
+static float randomValue(uint32_t* seed, int lo, int hi)
+{
+    float m = 1.0f + (next(seed) >> 8) / 16777216.0f;
+    float v = ldexpf(m, lo + (int)(next(seed) % (hi - lo)));
+
+    return next(seed) & 1 ? -v : v;
+}
+
+/*
+ * ami602_orient() against libm within the range documented for the NEON
+ * path, in odd-sized batches so the scalar tail runs too, with zero axes
+ * mixed in.
+ */
+static void testOrient()
+{
+    enum { MAX_BATCH = 67, ROUNDS = 40000 };
+    static struct ami602_vec in[MAX_BATCH];
+    static struct ami602_orientation out[MAX_BATCH];
+    uint32_t seed = 2;
+    double maxError = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int count = next(&seed) % (MAX_BATCH + 1);
+
+        for (int i = 0; i < count; i++) {
+            float* v = in[i].accel;     // accel and mag are contiguous
+            for (int k = 0; k < 6; k++) {
+                switch (next(&seed) % 8) {
+                case 0: v[k] = 0.0f; break;
+                case 1: v[k] = randomValue(&seed, -126, 126); break;
+                default: v[k] = randomValue(&seed, -8, 10); break;
+                }
+            }
+        }
+        ami602_orient(in, count, out);
+
+        for (int i = 0; i < count; i++) {
+            const float* a = in[i].accel;
+            const float* m = in[i].mag;
+            double e[3] = { 0, 0, 0 };
+
+            if (m[0] != 0.0f || m[1] != 0.0f)
+                e[0] = angleError(out[i].azimuth, -m[1], m[0], 180);
+            if (a[1] != 0.0f || a[2] != 0.0f)
+                e[1] = angleError(out[i].pitch, -a[1], a[2], 0);
+            if (a[0] != 0.0f || a[2] != 0.0f)
+                e[2] = angleError(out[i].roll, -a[0], a[2], 0);
+            for (int k = 0; k < 3; k++) {
+                if (e[k] > maxError)
+                    maxError = e[k];
+            }
+            CHECK(e[0] <= AMI602_ATAN2_MAX_ERROR_DEG &&
+                    e[1] <= AMI602_ATAN2_MAX_ERROR_DEG &&
+                    e[2] <= AMI602_ATAN2_MAX_ERROR_DEG,
+                    "orientation of accel (%g, %g, %g) mag (%g, %g) is off "
+                    "by (%g, %g, %g) degrees", a[0], a[1], a[2], m[0], m[1],
+                    e[0], e[1], e[2]);
+        }
+    }
+    printf("ami602_orient: max error %.6f degrees\n", maxError);
+}
+
+int main()
+{
+    testConvert();
+    testAtan2();
+    testOrient();
+
+    if (sFailures) {
+        fprintf(stderr, "%d failure(s)\n", sFailures);
+        return 1;
+    }
+    printf("all conversion tests passed\n");
+    return 0;
+}
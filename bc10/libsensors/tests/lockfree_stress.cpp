@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Multi-threaded stress test of Seqlock and SpscRing, instantiated as the
+ * HAL uses them. Readers check every value they get for tearing and every
+ * record for loss, duplication or reordering. Exits non-zero on any
+ * failure.
+ *
+ * usage: sensors_bc10_lockfree_stress [<seconds per test>]
+ *
+ * It is also meant to be built with -fsanitize=thread; see below.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#if defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define __SANITIZE_THREAD__ 1
+#endif
+#endif
+
+#if defined(__SANITIZE_THREAD__)
+/*
+ * The host libcutils atomics are volatile accesses and barriers, which
+ * ThreadSanitizer cannot see as synchronization. Under it, stand in for
+ * the ones this test and the two headers use with the compiler's atomic
+ * builtins. The barriered load and store become sequentially consistent,
+ * as ThreadSanitizer does not model fences.
+ */
+#define ANDROID_CUTILS_ATOMIC_H
+#include <stdint.h>
+
+static inline int32_t android_atomic_acquire_load(volatile const int32_t* addr)
+{
+    return __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+}
+
+static inline int32_t android_atomic_release_load(volatile const int32_t* addr)
+{
+    return __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+}
+
+static inline void android_atomic_acquire_store(int32_t value,
+        volatile int32_t* addr)
+{
+    __atomic_store_n(addr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void android_atomic_release_store(int32_t value,
+        volatile int32_t* addr)
+{
+    __atomic_store_n(addr, value, __ATOMIC_RELEASE);
+}
+
+static inline int32_t android_atomic_inc(volatile int32_t* addr)
+{
+    return __atomic_fetch_add(addr, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Seqlock::read() copies the value while write() may be storing it and
+ * throws the copy away if so; ThreadSanitizer reports that race however
+ * it ends. Whether a torn copy is ever kept is what testSeqlock() checks.
+ */
+extern "C" const char* __tsan_default_suppressions()
+{
+    return "race:seqlock_bc10.h\n";
+}
+#endif
+
+#include "../convert_bc10.h"
+#include "../poll_bc10.h"
+#include "../ring_bc10.h"
+#include "../seqlock_bc10.h"
+
+/*****************************************************************************/
+
+enum { NUM_READERS = 3 };
+
+static int64_t sDuration;
+static volatile int32_t sStop;
+static volatile int32_t sFailures;
+static volatile int32_t sReads;
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void fail(const char* what, long long expected, long long got)
+{
+    if (android_atomic_inc(&sFailures) < 10)
+        fprintf(stderr, "%s: expected %lld, got %lld\n", what, expected, got);
+}
+
+static uint32_t next(uint32_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/*****************************************************************************/
+
+// Same layout as the control-plane snapshot in poll_bc10.cpp.
+struct Config {
+    uint32_t enabled;
+    uint32_t generation;
+    int64_t period;
+    int64_t latency;
+    int64_t delays[MAX_NUM_SENSORS];
+};
+
+static Seqlock<Config> sConfig;
+static Seqlock<ami602_coeffs> sCoeffs;
+
+// Every field of publication g is derived from g.
+static void makeConfig(uint32_t g, Config* c)
+{
+    c->enabled = g;
+    c->generation = g;
+    c->period = (int64_t)g << 20;
+    c->latency = -(int64_t)g;
+    for (int h = 0; h < MAX_NUM_SENSORS; h++)
+        c->delays[h] = (int64_t)g * (h + 1);
+}
+
+static void makeCoeffs(uint32_t g, ami602_coeffs* c)
+{
+    for (int k = 0; k < 6; k++) {
+        c->bias[k] = g + k;
+        c->scale[k] = (float)(g & 0xffff) + k;
+        c->offset[k] = -(float)(g & 0xffff) - k;
+    }
+}
+
+static void* configWriter(void* arg)
+{
+    int64_t end = now() + sDuration;
+    uint32_t g = 0;
+    Config c;
+    ami602_coeffs k;
+
+    while (now() < end) {
+        for (int i = 0; i < 1000; i++) {
+            g++;
+            makeConfig(g, &c);
+            sConfig.write(c);
+            makeCoeffs(g, &k);
+            sCoeffs.write(k);
+        }
+    }
+    android_atomic_release_store(1, &sStop);
+    *(uint32_t*)arg = g;
+    return NULL;
+}
+
+/*
+ * A kept copy must be one whole publication, and no older than the last
+ * one this reader kept.
+ */
+static void* configReader(void*)
+{
+    uint32_t lastConfig = 0, lastCoeffs = 0;
+    Config c, want;
+    ami602_coeffs k, wantK;
+
+    while (!android_atomic_acquire_load(&sStop)) {
+        sConfig.read(&c);
+        makeConfig(c.generation, &want);
+        if (memcmp(&c, &want, sizeof(c)))
+            fail("torn Config, generation", c.generation, c.enabled);
+        if (c.generation < lastConfig)
+            fail("Config went back to generation", lastConfig, c.generation);
+        lastConfig = c.generation;
+
+        sCoeffs.read(&k);
+        makeCoeffs(k.bias[0], &wantK);
+        if (memcmp(&k, &wantK, sizeof(k)))
+            fail("torn coefficients, generation", k.bias[0], k.bias[5] - 5);
+        if ((uint32_t)k.bias[0] < lastCoeffs)
+            fail("coefficients went back to generation", lastCoeffs,
+                    k.bias[0]);
+        lastCoeffs = k.bias[0];
+        android_atomic_inc(&sReads);
+    }
+    return NULL;
+}
+
+static void testSeqlock()
+{
+    pthread_t writer, readers[NUM_READERS];
+    uint32_t written;
+
+    sStop = 0;
+    pthread_create(&writer, NULL, configWriter, &written);
+    for (int i = 0; i < NUM_READERS; i++)
+        pthread_create(&readers[i], NULL, configReader, NULL);
+    pthread_join(writer, NULL);
+    for (int i = 0; i < NUM_READERS; i++)
+        pthread_join(readers[i], NULL);
+    printf("Seqlock: %u writes, %d reads\n", written, sReads);
+}
+
+/*****************************************************************************/
+
+static SpscRing<ami602_sample, AMI602_RING_SIZE> sRing;
+
+// Sample n, with every field derived from n.
+static void makeSample(uint32_t n, ami602_sample* s)
+{
+    int* raw = &s->pos.accel_x;
+
+    s->timestamp = n;
+    for (int k = 0; k < 6; k++)
+        raw[k] = (int)(n * (k + 3));
+}
+
+/*
+ * Writes samples in random batches, as the sampler does, backing off
+ * while the ring is full.
+ */
+static void* producer(void*)
+{
+    enum { MAX_BATCH = 80 };
+    ami602_sample batch[MAX_BATCH];
+    int64_t end = now() + sDuration;
+    uint32_t n = 0, seed = 1;
+
+    while (now() < end) {
+        int count = 1 + next(&seed) % MAX_BATCH;
+
+        for (int i = 0; i < count; i++)
+            makeSample(n + i, &batch[i]);
+        // Yield while the ring is full, so a single CPU makes progress.
+        for (int done = 0; done < count; ) {
+            int written = sRing.write(batch + done, count - done);
+            if (!written)
+                sched_yield();
+            done += written;
+        }
+        n += count;
+    }
+    android_atomic_release_store(1, &sStop);
+    return NULL;
+}
+
+/*
+ * Reads in random batches and checks that samples arrive whole, in order
+ * and exactly once, then drains what is left once the producer stops.
+ */
+static void* consumer(void* arg)
+{
+    enum { MAX_BATCH = 100 };
+    ami602_sample batch[MAX_BATCH], want;
+    uint32_t n = 0, seed = 2;
+    bool stopped = false;
+
+    for (;;) {
+        int count = sRing.read(batch, 1 + next(&seed) % MAX_BATCH);
+
+        for (int i = 0; i < count; i++, n++) {
+            makeSample(n, &want);
+            if (memcmp(&batch[i], &want, sizeof(want))) {
+                fail("bad sample at", n, (long long)batch[i].timestamp);
+                n = (uint32_t)batch[i].timestamp;
+            }
+        }
+        if (!count) {
+            if (stopped)
+                break;
+            stopped = android_atomic_acquire_load(&sStop) != 0;
+            sched_yield();
+        }
+    }
+    *(uint32_t*)arg = n;
+    return NULL;
+}
+
+static void testRing()
+{
+    pthread_t p, c;
+    uint32_t received;
+
+    sStop = 0;
+    pthread_create(&c, NULL, consumer, &received);
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    if (sRing.size() != 0)
+        fail("samples left in the ring", 0, sRing.size());
+    printf("SpscRing: %u samples\n", received);
+}
+
+/*****************************************************************************/
+
+int main(int argc, char** argv)
+{
+    sDuration = (int64_t)((argc > 1 ? atof(argv[1]) : 2.0) * 1e9);
+
+    testSeqlock();
+    testRing();
+
+    if (sFailures) {
+        fprintf(stderr, "%d failure(s)\n", sFailures);
+        return 1;
+    }
+    printf("all lock-free tests passed\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Host benchmark of the HAL's delivery path. It opens the HAL on a stand-in
+ * source and, for every combination of enabled sensors, sampling rate and
+ * poll() buffer size below, runs poll() in a loop and reports the events
+ * delivered per second and per call, and the p50/p99/p999/max latency from
+ * capture timestamp to return.
+ *
+ * usage: sensors_bc10_poll_bench [-t <seconds per run>] [-f] [<source>]
+ *
+ * <source> is an AMI602_SOURCE_PROPERTY value, "stub" by default; -f plays
+ * a "replay:<path>" source back as fast as the HAL takes it, for raw
+ * throughput. Fast replay stamps samples ahead of wall time, so its
+ * latencies are not meaningful. Runs of 2 s give a p999 only at the
+ * higher rates; lengthen them with -t for the slow ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <hardware/sensors.h>
+
+#include "../poll_bc10.h"
+#include "../record_bc10.h"
+#include "../source_bc10.h"
+#include "../stats_bc10.h"
+
+extern "C" const struct sensors_module_t HAL_MODULE_INFO_SYM;
+
+/*****************************************************************************/
+
+static const struct {
+    const char* name;
+    uint32_t mask;
+} sSensorSets[] = {
+    { "A",      1 << ID_A },
+    { "A+M",    (1 << ID_A) | (1 << ID_M) },
+    { "A+M+O",  (1 << ID_A) | (1 << ID_M) | (1 << ID_O) },
+    { "all",    (1 << MAX_NUM_SENSORS) - 1 },
+};
+
+static const int64_t sDelays[] = {
+    AMI602_MIN_DELAY_NS,
+    20000000,               // 50 Hz
+    66666667,               // 15 Hz
+};
+
+static const int sCounts[] = { 1, 16, 64 };
+
+// Events delivered while a run settles are not measured.
+#define WARMUP_NS   200000000LL
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void enable(struct sensors_poll_device_t* dev, uint32_t mask,
+        int64_t delay)
+{
+    for (int h = 0; h < MAX_NUM_SENSORS; h++) {
+        if (!(mask & (1 << h)))
+            continue;
+        dev->setDelay(dev, h, delay);
+        dev->activate(dev, h, 1);
+    }
+}
+
+static void disable(struct sensors_poll_device_t* dev, uint32_t mask)
+{
+    for (int h = 0; h < MAX_NUM_SENSORS; h++) {
+        if (mask & (1 << h))
+            dev->activate(dev, h, 0);
+    }
+}
+
+/*
+ * Polls count events at a time for duration ns after the warm-up and
+ * prints one line of results.
+ */
+static void run(struct sensors_poll_device_t* dev, const char* sensors,
+        int64_t delay, int count, int64_t duration)
+{
+    sensors_event_t data[64];
+    LatencyHistogram latency;
+    uint32_t returns = 0;
+    int64_t start = now() + WARMUP_NS;
+    int64_t end = start + duration;
+    int64_t t;
+
+    do {
+        int n = dev->poll(dev, data, count);
+
+        t = now();
+        if (t < start || n <= 0)
+            continue;
+        for (int i = 0; i < n; i++) {
+#ifdef SENSORS_DEVICE_API_VERSION_1_1
+            if (data[i].type == SENSOR_TYPE_META_DATA)
+                continue;
+#endif
+            latency.add(t - data[i].timestamp);
+        }
+        returns++;
+    } while (t < end);
+
+    printf("%-6s %6.1f %6d %10.0f %8.2f %8lld %8lld %8lld %8lld\n",
+            sensors, 1e9 / delay, count,
+            latency.count() * 1e9 / duration,
+            returns ? (double)latency.count() / returns : 0.0,
+            (long long)(latency.percentile(0.5f) / 1000),
+            (long long)(latency.percentile(0.99f) / 1000),
+            (long long)(latency.percentile(0.999f) / 1000),
+            (long long)(latency.max() / 1000));
+}
+
+int main(int argc, char** argv)
+{
+    const char* source = "stub";
+    double seconds = 2.0;
+    bool fast = false;
+    struct hw_device_t* device;
+    struct sensors_poll_device_t* dev;
+    int opt, err;
+
+    while ((opt = getopt(argc, argv, "t:f")) != -1) {
+        switch (opt) {
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'f':
+            fast = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t <seconds per run>] [-f] "
+                    "[<source>]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc)
+        source = argv[optind];
+
+    property_set(AMI602_SOURCE_PROPERTY, source);
+    property_set(AMI602_REPLAY_PROPERTY, fast ? "fast" : "realtime");
+
+    err = HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+            SENSORS_HARDWARE_POLL, &device);
+    if (err) {
+        fprintf(stderr, "cannot open the HAL on %s (%s)\n", source,
+                strerror(-err));
+        return 1;
+    }
+    dev = (struct sensors_poll_device_t*)device;
+
+    printf("source %s%s, %.1f s per run\n", source, fast ? " (fast)" : "",
+            seconds);
+    printf("%-6s %6s %6s %10s %8s %8s %8s %8s %8s\n", "sensors", "Hz",
+            "count", "events/s", "per call", "p50 us", "p99 us", "p999 us",
+            "max us");
+    for (size_t s = 0; s < sizeof(sSensorSets) / sizeof(*sSensorSets); s++) {
+        for (size_t d = 0; d < sizeof(sDelays) / sizeof(*sDelays); d++) {
+            enable(dev, sSensorSets[s].mask, sDelays[d]);
+            for (size_t c = 0; c < sizeof(sCounts) / sizeof(*sCounts); c++) {
+                run(dev, sSensorSets[s].name, sDelays[d], sCounts[c],
+                        (int64_t)(seconds * 1e9));
+            }
+            disable(dev, sSensorSets[s].mask);
+        }
+    }
+
+    device->close(device);
+    return 0;
+}
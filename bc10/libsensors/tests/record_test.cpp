@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Round trip of a raw sample recording through Ami602Recorder and the
+ * Ami602Replay source, in fast and realtime mode, and the replay source's
+ * handling of files that are not recordings. Exits non-zero on any
+ * failure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cutils/properties.h>
+
+#include "../poll_bc10.h"
+#include "../record_bc10.h"
+#include "../source_bc10.h"
+
+/*****************************************************************************/
+
+static int sFailures;
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            if (sFailures++ < 10) {                     \
+                fprintf(stderr, __VA_ARGS__);           \
+                fprintf(stderr, "\n");                  \
+            }                                           \
+        }                                               \
+    } while (0)
+
+enum { NUM_RECS = 1000 };
+
+#define SPACING_NS  10000000LL          // 100 Hz
+#define START_NS    123456789LL
+
+static char sPath[] = "/tmp/sensors_bc10_record_test.XXXXXX";
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// Recorded sample n, with every field derived from n.
+static void makeSample(int n, struct ami602_sample* s)
+{
+    int* raw = &s->pos.accel_x;
+
+    s->timestamp = START_NS + n * SPACING_NS;
+    for (int k = 0; k < 6; k++)
+        raw[k] = 2048 + n * (k + 1) % 977;
+}
+
+static bool samePosition(const struct ami602_position* a, int n)
+{
+    struct ami602_sample want;
+
+    makeSample(n, &want);
+    return !memcmp(a, &want.pos, sizeof(*a));
+}
+
+static void writeFile(const void* data, size_t size)
+{
+    FILE* f = fopen(sPath, "w");
+
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+/*****************************************************************************/
+
+// Records NUM_RECS samples in uneven appends.
+static void testRecord()
+{
+    Ami602Recorder* recorder = new Ami602Recorder();
+    struct ami602_sample recs[97];
+    struct stat st;
+    int n = 0;
+
+    CHECK(recorder->open(sPath) == 0, "cannot create %s", sPath);
+    while (n < NUM_RECS) {
+        int count = NUM_RECS - n < 97 ? NUM_RECS - n : 1 + n % 97;
+        for (int i = 0; i < count; i++)
+            makeSample(n + i, &recs[i]);
+        recorder->append(recs, count);
+        n += count;
+    }
+    recorder->flush();
+    delete recorder;
+
+    CHECK(stat(sPath, &st) == 0 && st.st_size == (off_t)(sizeof(
+            struct ami602_rec_header) + NUM_RECS * sizeof(struct ami602_sample)),
+            "recording is %lld bytes", (long long)st.st_size);
+}
+
+/*
+ * Fast mode hands out the recording as quickly as it is read, looping at
+ * the end, with the recorded spacing kept across the loop and the first
+ * sample stamped when streaming starts.
+ */
+static void testFastReplay()
+{
+    struct ami602_sample recs[64];
+    int64_t start, last = 0;
+    int n = 0;
+
+    property_set(AMI602_REPLAY_PROPERTY, "fast");
+    Ami602Replay replay(sPath);
+    CHECK(replay.open() == 0, "cannot open the recording");
+    start = now();
+    CHECK(replay.startFifo(SPACING_NS) == 0, "cannot start the replay");
+    while (n < 5 * NUM_RECS / 2) {
+        int count = replay.readFifo(recs, 1 + n % 64);
+
+        CHECK(count > 0, "fast replay stalled after %d samples", n);
+        if (count <= 0)
+            break;
+        for (int i = 0; i < count; i++, n++) {
+            CHECK(samePosition(&recs[i].pos, n % NUM_RECS),
+                    "replayed sample %d differs", n);
+            if (n == 0) {
+                CHECK(recs[i].timestamp >= start &&
+                        recs[i].timestamp <= now(),
+                        "replay starts at %lld, not now",
+                        (long long)recs[i].timestamp);
+            } else {
+                CHECK(recs[i].timestamp - last == SPACING_NS,
+                        "sample %d is %lld ns after the previous one", n,
+                        (long long)(recs[i].timestamp - last));
+            }
+            last = recs[i].timestamp;
+        }
+    }
+    replay.close();
+}
+
+// Realtime mode never hands out a sample before its timestamp.
+static void testRealtimeReplay()
+{
+    struct ami602_sample recs[64];
+    struct pollfd fds;
+    int n = 0;
+
+    property_set(AMI602_REPLAY_PROPERTY, "realtime");
+    Ami602Replay replay(sPath);
+    CHECK(replay.open() == 0, "cannot open the recording");
+    CHECK(replay.startFifo(SPACING_NS) == 0, "cannot start the replay");
+    while (n < 30) {
+        fds.fd = replay.fd();
+        fds.events = POLLIN;
+        if (poll(&fds, 1, 1000) <= 0) {
+            CHECK(false, "realtime replay stalled after %d samples", n);
+            break;
+        }
+        int count = replay.readFifo(recs, 64);
+        int64_t t = now();
+        for (int i = 0; i < count; i++, n++) {
+            CHECK(samePosition(&recs[i].pos, n), "replayed sample %d differs",
+                    n);
+            CHECK(recs[i].timestamp <= t, "sample %d came %lld ns early", n,
+                    (long long)(recs[i].timestamp - t));
+        }
+    }
+    replay.close();
+}
+
+// Anything but a non-empty recording of this sample layout is refused.
+static void testBadFiles()
+{
+    struct ami602_rec_header hdr;
+    struct ami602_sample rec;
+    char buf[sizeof(hdr) + sizeof(rec)];
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = AMI602_REC_MAGIC;
+    hdr.version = AMI602_REC_VERSION;
+    hdr.record_size = sizeof(rec);
+    makeSample(0, &rec);
+
+    const struct {
+        const char* what;
+        uint32_t magic;
+        uint16_t version;
+        uint16_t record_size;
+        size_t size;
+    } cases[] = {
+        { "bad magic", 0x12345678, hdr.version, hdr.record_size, sizeof(buf) },
+        { "bad version", hdr.magic, 2, hdr.record_size, sizeof(buf) },
+        { "bad record size", hdr.magic, hdr.version, 20, sizeof(buf) },
+        { "no samples", hdr.magic, hdr.version, hdr.record_size, sizeof(hdr) },
+        { "short header", hdr.magic, hdr.version, hdr.record_size, 6 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        struct ami602_rec_header bad = hdr;
+
+        bad.magic = cases[i].magic;
+        bad.version = cases[i].version;
+        bad.record_size = cases[i].record_size;
+        memcpy(buf, &bad, sizeof(bad));
+        memcpy(buf + sizeof(bad), &rec, sizeof(rec));
+        writeFile(buf, cases[i].size);
+
+        Ami602Replay replay(sPath);
+        CHECK(replay.open() == -EINVAL, "%s: not refused", cases[i].what);
+    }
+
+    unlink(sPath);
+    Ami602Replay missing(sPath);
+    CHECK(missing.open() == -ENOENT, "missing recording: not refused");
+}
+
+int main()
+{
+    int fd = mkstemp(sPath);
+
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    testRecord();
+    testFastReplay();
+    testRealtimeReplay();
+    testBadFiles();
+    unlink(sPath);
+
+    if (sFailures) {
+        fprintf(stderr, "%d failure(s)\n", sFailures);
+        return 1;
+    }
+    printf("all recording tests passed\n");
+    return 0;
+}